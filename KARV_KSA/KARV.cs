@@ -14,6 +14,9 @@ namespace KARV
     {
         public const uint TARGET_STEPS_PER_TICK = 65536*5;
         private bool on = true;
+        private IntPtr karvContext = IntPtr.Zero;
+        private bool stepping = false; //A karv_step_async is running
+        private int kbBufferLenGiven = 0;
         
         struct stepRetVal {
             public int statusCode;
@@ -21,46 +24,66 @@ namespace KARV
         };
         
         [DllImport("libkarv")]
-        private static extern void setup(ushort width, ushort height);
+        private static extern IntPtr karv_create(ushort width, ushort height, string logPath);
         [DllImport("libkarv")]
-        private static unsafe extern stepRetVal step(byte *buffer, char *kbBuffer, int len, uint targetSteps);
+        private static unsafe extern int karv_step_async(IntPtr context, byte *kbBuffer, int len, uint targetSteps);
         [DllImport("libkarv")]
-        private static extern void cleanup();
+        private static extern int karv_step_ready(IntPtr context);
+        [DllImport("libkarv")]
+        private static unsafe extern stepRetVal karv_step_wait(IntPtr context, byte *buffer);
+        [DllImport("libkarv")]
+        private static extern void karv_destroy(IntPtr context);
         
         //public ImTextureRef texID;
-        Stack<char> keyboardBuffer;
-        private byte[] vram;
+        List<char> keyboardBuffer; //Oldest first, the order libkarv reads them in
 
         [StarMapAfterGui]
         public void OnAfterUi(double dt)
         {
             Console.WriteLine("Hi from KARV!");
             
-            if (!on) {
+            if (!on || karvContext == IntPtr.Zero) {
                 return;
             }
             
-            stepRetVal ret;
-            unsafe {
-                fixed (byte *buffer = vram) {
-                    fixed (char *kbBuffer = keyboardBuffer.ToArray()) {
-                        ret = step(buffer, kbBuffer, keyboardBuffer.Count, TARGET_STEPS_PER_TICK);
-                    }
+            //The emulator runs on its own thread, only take its frame once it has finished one
+            if (stepping) {
+                if (karv_step_ready(karvContext) == 0) {
+                    return;
+                }
+                stepRetVal ret;
+                unsafe {
+                    //The frame stays in libkarv's own framebuffer, nothing needs copying out
+                    ret = karv_step_wait(karvContext, null);
+                }
+                stepping = false;
+
+                //libkarv used the oldest of the keys it was given. Keys typed while it was running come after them,
+                //so they stay for the next step.
+                int used = kbBufferLenGiven - ret.kbBufferLen;
+                keyboardBuffer.RemoveRange(0, Math.Min(used, keyboardBuffer.Count));
+                
+                switch( ret.statusCode )
+                {
+                    case 0: break;
+                    case 1: break; //Idle, libkarv already skipped ahead to the next timer interrupt
+                    case 3: Console.WriteLine("Tried to reset instct"); break;//instct = 0; break;
+                    case 0x7777: Console.WriteLine("Tried to restart"); break;	//syscon code for restart
+                    case 0x5555: Console.WriteLine("POWEROFF"); on = false; return;//printf( "POWEROFF@0x%08x%08x\n", core->cycleh, core->cyclel ); running = 0; break; //syscon code for power-off
+                    default: Console.WriteLine( "Unknown failure" ); break;
                 }
             }
-            
-            while (ret.kbBufferLen < keyboardBuffer.Count) {
-                keyboardBuffer.Pop();
-            }
-            
-            switch( ret.statusCode )
-            {
-                case 0: break;
-                case 1: Console.WriteLine("Tried to sleep"); break;//if( do_sleep ) MiniSleep(); *this_ccount += instrs_per_flip; break;
-                case 3: Console.WriteLine("Tried to reset instct"); break;//instct = 0; break;
-                case 0x7777: Console.WriteLine("Tried to restart"); break;	//syscon code for restart
-                case 0x5555: Console.WriteLine("POWEROFF"); on = false; break;//printf( "POWEROFF@0x%08x%08x\n", core->cycleh, core->cyclel ); running = 0; break; //syscon code for power-off
-                default: Console.WriteLine( "Unknown failure" ); break;
+
+            unsafe {
+                //libkarv copies the keys, so the array only needs to live through the call
+                byte[] keys = new byte[keyboardBuffer.Count]; //A byte each, as libkarv reads them
+                for (int i=0; i<keys.Length; i++) {
+                    keys[i] = (byte)keyboardBuffer[i];
+                }
+                fixed (byte *kbBuffer = keys) {
+                    kbBufferLenGiven = keys.Length;
+                    stepping = karv_step_async(karvContext, kbBuffer, kbBufferLenGiven, TARGET_STEPS_PER_TICK) == 0;
+                }
             }
             
             /*ImGuiWindowFlags flags = ImGuiWindowFlags.MenuBar;
@@ -124,10 +147,8 @@ namespace KARV
         [StarMapBeforeMain]
         public void OnBeforeMain()
         {
-            setup(400, 400);
-            keyboardBuffer = new Stack<char>();
-            
-            vram = new byte[400*400*4];
+            karvContext = karv_create(400, 400, "rvlog.txt");
+            keyboardBuffer = new List<char>();
             
             Console.WriteLine($"SimpleMod - On before main loaded!");
         }
@@ -164,6 +185,9 @@ namespace KARV
         public void Unload()
         {
             Console.WriteLine("SimpleMod - Unload");
+            //karv_destroy waits for a step that's still running
+            karv_destroy(karvContext);
+            karvContext = IntPtr.Zero;
             //Patcher.Unload();
         }
     }
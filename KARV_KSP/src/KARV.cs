@@ -5,6 +5,7 @@
  |  -Calling libkarv                                                          |
  |  -Presentation of the final framebuffer                                    |
  |  -Passing keyboard inputs to libkarv                                       |
+ |  -Saving and loading the computer along with the game                      |
  |  -All UI tasks                                                             |
  |  -(Future) Vessel data/control interface                                   |
 \*----------------------------------------------------------------------------*/
@@ -24,13 +25,56 @@ namespace KARV
             public int statusCode;
             public int kbBufferLen;
         };
+
+        //Mirrors KARVStepJob in libkarv.c
+        [StructLayout(LayoutKind.Sequential)]
+        struct KARVStepJob {
+            public System.IntPtr context;
+            public System.IntPtr vram;
+            public System.IntPtr kbBuffer;
+            public int kbBufferLen;
+            public uint targetSteps;
+            public stepRetVal ret;
+            public uint stepsRun;
+        };
+
+        //Mirrors KARVScreenMode in libkarv.c
+        [StructLayout(LayoutKind.Sequential)]
+        struct KARVScreenMode {
+            public uint width;
+            public uint height;
+            public uint format;
+        };
+        private const uint SCREEN_FORMAT_RGB565 = 1;
+        private const uint SCREEN_FORMAT_INDEXED8 = 2;
+
+        //Every computer in flight gets stepped by one background batch per physics tick, the next tick
+        //collects its results and frames before starting another one
+        private static List<KARVComputer> activeComputers = new List<KARVComputer>();
+        private static System.IntPtr karvPool = System.IntPtr.Zero;
+        private static float lastBatchTime = -1.0f;
+        //Never stepped, every computer starts as a clone of it so they all share its RAM until they write to it
+        private static System.IntPtr templateContext = System.IntPtr.Zero;
+
+        //The batch libkarv is running right now, all of it stays pinned until karv_step_batch_wait
+        private static List<KARVComputer> batchComputers = null;
+        private static KARVStepJob[] batchJobs;
+        private static GCHandle batchJobsHandle;
+        private static GCHandle[] batchKbHandles;
         
         [KSPField(guiActive = true, guiActiveEditor = true, guiName = "Terminal"), UI_Toggle(enabledText = "Hide terminal", disabledText = "Show terminal")]
         public bool showTerminal = false;
 
         private bool on = true;
-        private byte[] vram;
-        Stack<char> keyboardBuffer;
+        private System.IntPtr karvContext = System.IntPtr.Zero; //One libkarv computer per part
+        private string pendingStateFile = null; //From OnLoad, for when the context didn't exist yet
+        private string pendingDeltaFile = null;
+        private bool rebaseState = true; //Write the whole computer next save instead of a delta
+        private System.IntPtr saveJob = System.IntPtr.Zero; //The save libkarv is writing in the background
+        private string saveJobDelta = null; //Path of the delta it's writing, null for a whole save
+        private ulong uploadedGeneration = ulong.MaxValue; //Of the frame the texture has, so unchanged ones aren't uploaded again
+        private byte[] rgbaFrame = null; //Indexed frames get expanded into this, Unity has no paletted textures
+        List<char> keyboardBuffer; //Oldest first, the order libkarv reads them in
         GameObject uiImageObject;
         UnityEngine.UI.RawImage fbUIRawImage;
         bool initialized = false;
@@ -39,16 +83,61 @@ namespace KARV
         RectTransform rectTransform;
 
         [DllImport("libkarv")]
-        private static extern void setup(ushort width, ushort height);
+        private static extern System.IntPtr karv_create(ushort width, ushort height, string logPath);
+        [DllImport("libkarv")]
+        private static extern System.IntPtr karv_clone(System.IntPtr context, string logPath);
+        [DllImport("libkarv")]
+        private static extern void karv_destroy(System.IntPtr context);
+        [DllImport("libkarv")]
+        private static extern int karv_save_state(System.IntPtr context, string path);
+        [DllImport("libkarv")]
+        private static extern int karv_load_state(System.IntPtr context, string path);
+        [DllImport("libkarv")]
+        private static extern int karv_save_state_delta(System.IntPtr context, string path);
+        [DllImport("libkarv")]
+        private static extern int karv_load_state_delta(System.IntPtr context, string basePath, string deltaPath);
+        [DllImport("libkarv")]
+        private static extern System.IntPtr karv_save_state_async(System.IntPtr context, string path);
+        [DllImport("libkarv")]
+        private static extern System.IntPtr karv_save_state_delta_async(System.IntPtr context, string path);
+        [DllImport("libkarv")]
+        private static extern int karv_save_ready(System.IntPtr job);
+        [DllImport("libkarv")]
+        private static extern int karv_save_wait(System.IntPtr job);
+        [DllImport("libkarv")]
+        private static extern System.IntPtr karv_pool_create(int numThreads);
+        [DllImport("libkarv")]
+        private static extern int karv_step_batch_async(System.IntPtr pool, System.IntPtr jobs, int numJobs, uint deadlineUs);
+        [DllImport("libkarv")]
+        private static extern int karv_step_batch_ready(System.IntPtr pool);
         [DllImport("libkarv")]
-        private static unsafe extern stepRetVal step(byte *buffer, char *kbBuffer, int len, uint targetSteps);
+        private static extern void karv_step_batch_wait(System.IntPtr pool);
         [DllImport("libkarv")]
-        private static extern void cleanup();
+        private static extern void karv_pool_destroy(System.IntPtr pool);
+        [DllImport("libkarv")]
+        private static extern System.IntPtr karv_get_framebuffer(System.IntPtr context);
+        [DllImport("libkarv")]
+        private static extern ulong karv_get_frame_generation(System.IntPtr context);
+        [DllImport("libkarv")]
+        private static extern void karv_get_screen_mode(System.IntPtr context, out KARVScreenMode mode);
+        [DllImport("libkarv")]
+        private static extern void karv_frame_to_rgba(System.IntPtr context, byte[] dst);
 
         public override void OnInitialize()
         {
             Debug.Log("setup");
-            setup(400, 400);
+            if (templateContext == System.IntPtr.Zero) {
+                templateContext = karv_create(400, 400, "rvlog-template.txt");
+            }
+            karvContext = templateContext != System.IntPtr.Zero ? karv_clone(templateContext, "rvlog-" + part.flightID + ".txt") : System.IntPtr.Zero;
+            if (karvContext == System.IntPtr.Zero) {
+                karvContext = karv_create(400, 400, "rvlog-" + part.flightID + ".txt");
+            }
+            if (pendingStateFile != null) {
+                LoadState(pendingStateFile, pendingDeltaFile);
+                pendingStateFile = null;
+                pendingDeltaFile = null;
+            }
 
             UnityEngine.Texture2D fbTex = new UnityEngine.Texture2D(400, 400, TextureFormat.RGBA32, false); //FramebufferTexture
             var fbData = fbTex.GetRawTextureData<Color32>();
@@ -74,10 +163,9 @@ namespace KARV
             //rectTransform.localScale.y *= -1;
             uiImageObject.SetActive(true);
 
-            keyboardBuffer = new Stack<char>();
+            keyboardBuffer = new List<char>();
 
-            vram = new byte[fbTex.width*fbTex.height*4];
-            
+            activeComputers.Add(this);
             initialized = true;
         }
 
@@ -117,15 +205,90 @@ namespace KARV
             if (ev.isKey && ev.type == EventType.KeyDown) {
                 if (ev.character >= ' ' && ev.character <= '~') {
                     Debug.Log("KARV: OnGUI \'" + ev.character + "\'");
-                    keyboardBuffer.Push(ev.character);
+                    keyboardBuffer.Add(ev.character);
                 } else if (ev.keyCode == KeyCode.Return) {
-                    keyboardBuffer.Push('\n');
+                    keyboardBuffer.Add('\n');
                 } else if (ev.keyCode == KeyCode.Backspace) {
-                    keyboardBuffer.Push((char)127); //127 is DEL
+                    keyboardBuffer.Add((char)127); //127 is DEL
                 }
             }
         }
 
+        //The guest is kept in a file of its own next to the save, the save only gets its name
+        private static string StateDirectory() {
+            return System.IO.Path.Combine(KSPUtil.ApplicationRootPath, "saves", HighLogic.SaveFolder, "KARV");
+        }
+
+        //Most saves only write a delta with the pages the guest wrote since the last whole save, which is
+        //only written again once the deltas stop being much smaller than it. libkarv freezes the computer
+        //right away but writes the file in the background, so saving doesn't hitch the game.
+        public override void OnSave(ConfigNode node) {
+            if (!HighLogic.LoadedSceneIsFlight || karvContext == System.IntPtr.Zero) {
+                return;
+            }
+            //libkarv can't save a computer while the batch is stepping it
+            FinishBatch();
+            FinishSave(true);
+            string fileName = "computer-" + part.flightID + ".karvstate";
+            string deltaName = "computer-" + part.flightID + ".karvdelta";
+            string path = System.IO.Path.Combine(StateDirectory(), fileName);
+            string deltaPath = System.IO.Path.Combine(StateDirectory(), deltaName);
+            System.IO.Directory.CreateDirectory(StateDirectory());
+            if (!rebaseState && (saveJob = karv_save_state_delta_async(karvContext, deltaPath)) != System.IntPtr.Zero) {
+                node.AddValue("stateFile", fileName);
+                node.AddValue("deltaFile", deltaName);
+                saveJobDelta = deltaPath;
+            } else if ((saveJob = karv_save_state_async(karvContext, path)) != System.IntPtr.Zero) {
+                node.AddValue("stateFile", fileName);
+                saveJobDelta = null;
+                rebaseState = false;
+            } else {
+                Debug.Log("KARV: failed to save computer " + part.flightID);
+            }
+        }
+
+        //Collects the background save once it's written, or right away if block is set. Only call while the
+        //batch isn't stepping this computer.
+        private void FinishSave(bool block) {
+            if (saveJob == System.IntPtr.Zero || (!block && karv_save_ready(saveJob) == 0)) {
+                return;
+            }
+            int result = karv_save_wait(saveJob);
+            saveJob = System.IntPtr.Zero;
+            if (result != 0) {
+                Debug.Log("KARV: failed to save computer " + part.flightID);
+                rebaseState = true;
+            } else if (saveJobDelta != null) {
+                string path = System.IO.Path.Combine(StateDirectory(), "computer-" + part.flightID + ".karvstate");
+                rebaseState = new System.IO.FileInfo(saveJobDelta).Length * 2 > new System.IO.FileInfo(path).Length;
+            }
+        }
+
+        public override void OnLoad(ConfigNode node) {
+            if (!HighLogic.LoadedSceneIsFlight || !node.HasValue("stateFile")) {
+                return;
+            }
+            string deltaFile = node.HasValue("deltaFile") ? node.GetValue("deltaFile") : null;
+            if (karvContext == System.IntPtr.Zero) {
+                pendingStateFile = node.GetValue("stateFile");
+                pendingDeltaFile = deltaFile;
+            } else {
+                LoadState(node.GetValue("stateFile"), deltaFile);
+            }
+        }
+
+        private void LoadState(string fileName, string deltaFile) {
+            FinishBatch();
+            FinishSave(true);
+            string path = System.IO.Path.Combine(StateDirectory(), fileName);
+            int result = deltaFile != null ? karv_load_state_delta(karvContext, path, System.IO.Path.Combine(StateDirectory(), deltaFile)) : karv_load_state(karvContext, path);
+            //A failed load leaves libkarv without a base for deltas either way
+            rebaseState = result != 0;
+            if (result != 0) {
+                Debug.Log("KARV: couldn't load " + (deltaFile ?? fileName) + ", the computer starts fresh");
+            }
+        }
+
         public override void OnStart(StartState state)
         {
             Debug.Log("KARV: OnStart");
@@ -137,7 +300,7 @@ namespace KARV
 
         public void Update() {
             fbUIRawImage.enabled = showTerminal;
-            if (showTerminal) {
+            if (showTerminal && karvContext != System.IntPtr.Zero) {
                 UnityEngine.Texture2D fbTex = (Texture2D)GameObject.Find("framebufferUIImageObject").GetComponent<UnityEngine.UI.RawImage>().texture;
                 
                 /*var fbData = fbTex.GetRawTextureData<Color32>();
@@ -152,36 +315,121 @@ namespace KARV
                     }
                 }*/
                 //fbTex.SetPixelData<Color32>(fbData, 0);
-                fbTex.SetPixelData(vram, 0, 0);
-                fbTex.Apply(false, false);
+                //libkarv's framebuffer only changes when a batch finishes, on this thread, so it's read straight from
+                //there. Apply always uploads the whole texture, so all there is to save is the frames where nothing changed.
+                ulong generation = karv_get_frame_generation(karvContext);
+                if (generation != uploadedGeneration) {
+                    //The guest can change the screen's size and format, the texture follows it
+                    KARVScreenMode mode;
+                    karv_get_screen_mode(karvContext, out mode);
+                    TextureFormat format = mode.format == SCREEN_FORMAT_RGB565 ? TextureFormat.RGB565 : TextureFormat.RGBA32;
+                    if (fbTex.width != mode.width || fbTex.height != mode.height || fbTex.format != format) {
+                        fbTex.Resize((int)mode.width, (int)mode.height, format, false);
+                    }
+                    int numPixels = (int)(mode.width*mode.height);
+                    if (mode.format == SCREEN_FORMAT_INDEXED8) {
+                        if (rgbaFrame == null || rgbaFrame.Length != numPixels*4) {
+                            rgbaFrame = new byte[numPixels*4];
+                        }
+                        karv_frame_to_rgba(karvContext, rgbaFrame);
+                        fbTex.LoadRawTextureData(rgbaFrame);
+                    } else {
+                        fbTex.LoadRawTextureData(karv_get_framebuffer(karvContext), numPixels*(mode.format == SCREEN_FORMAT_RGB565 ? 2 : 4));
+                    }
+                    fbTex.Apply(false, false);
+                    uploadedGeneration = generation;
+                }
             }
         }
 
         public void FixedUpdate() {
             //Debug.Log("KARV: FixedUpdate");
-            if (on) {
-                stepRetVal ret;
-                unsafe {
-                    fixed (byte *buffer = vram) {
-                        fixed (char *kbBuffer = keyboardBuffer.ToArray()) {
-                            ret = step(buffer, kbBuffer, keyboardBuffer.Count, TARGET_STEPS_PER_TICK);
-                        }
-                    }
-                }
+            //Whichever computer gets here first this tick steps all of them
+            if (lastBatchTime == Time.fixedTime) {
+                return;
+            }
+            lastBatchTime = Time.fixedTime;
+            StepAll();
+        }
 
-                while (ret.kbBufferLen < keyboardBuffer.Count) {
-                    keyboardBuffer.Pop();
+        private static void StepAll() {
+            if (batchComputers != null) {
+                //Last tick's batch is still going, keep showing the frames we have rather than stall the game
+                if (karv_step_batch_ready(karvPool) == 0) {
+                    return;
                 }
+                FinishBatch();
+            }
+            //Nothing is stepping any of them between batches
+            foreach (KARVComputer computer in activeComputers) {
+                computer.FinishSave(false);
+            }
 
-                switch( ret.statusCode )
-                {
-                    case 0: break;
-                    case 1: Debug.Log("Tried to sleep"); break;//if( do_sleep ) MiniSleep(); *this_ccount += instrs_per_flip; break;
-                    case 3: Debug.Log("Tried to reset instct"); break;//instct = 0; break;
-                    case 0x7777: Debug.Log("Tried to restart"); break;	//syscon code for restart
-                    case 0x5555: Debug.Log("POWEROFF"); on = false; break;//printf( "POWEROFF@0x%08x%08x\n", core->cycleh, core->cyclel ); running = 0; break; //syscon code for power-off
-                    default: Debug.Log( "Unknown failure" ); break;
-                }
+            List<KARVComputer> running = activeComputers.FindAll(c => c.on && c.karvContext != System.IntPtr.Zero);
+            if (running.Count == 0) {
+                return;
+            }
+            if (karvPool == System.IntPtr.Zero) {
+                karvPool = karv_pool_create(0);
+            }
+
+            batchJobs = new KARVStepJob[running.Count];
+            batchKbHandles = new GCHandle[running.Count];
+            for (int i=0; i<running.Count; i++) {
+                byte[] keys = running[i].KeyBytes();
+                batchKbHandles[i] = GCHandle.Alloc(keys, GCHandleType.Pinned);
+                batchJobs[i].context = running[i].karvContext;
+                batchJobs[i].vram = System.IntPtr.Zero; //Frames are read from karv_get_framebuffer instead
+                batchJobs[i].kbBuffer = batchKbHandles[i].AddrOfPinnedObject();
+                batchJobs[i].kbBufferLen = keys.Length;
+                batchJobs[i].targetSteps = TARGET_STEPS_PER_TICK;
+            }
+            batchJobsHandle = GCHandle.Alloc(batchJobs, GCHandleType.Pinned);
+            batchComputers = running;
+
+            //It runs off the main thread now, but should still be done by the next tick
+            karv_step_batch_async(karvPool, batchJobsHandle.AddrOfPinnedObject(), batchJobs.Length, (uint)(Time.fixedDeltaTime * 1000000.0f));
+        }
+
+        //Blocks until the running batch is done, which updates every computer's framebuffer, then handles the results
+        private static void FinishBatch() {
+            if (batchComputers == null) {
+                return;
+            }
+            karv_step_batch_wait(karvPool);
+            batchJobsHandle.Free();
+            for (int i=0; i<batchComputers.Count; i++) {
+                batchKbHandles[i].Free();
+                batchComputers[i].HandleStepResult(batchJobs[i].ret, batchJobs[i].kbBufferLen);
+            }
+            batchComputers = null;
+            batchJobs = null;
+            batchKbHandles = null;
+        }
+
+        //The keys waiting to be sent, as the single bytes libkarv reads
+        private byte[] KeyBytes() {
+            byte[] keys = new byte[keyboardBuffer.Count];
+            for (int i=0; i<keys.Length; i++) {
+                keys[i] = (byte)keyboardBuffer[i];
+            }
+            return keys;
+        }
+
+        private void HandleStepResult(stepRetVal ret, int kbBufferLenGiven) {
+            //libkarv used the oldest of the keys it was given. Keys typed while the batch was running come after
+            //them, so they stay for the next one.
+            int used = kbBufferLenGiven - ret.kbBufferLen;
+            keyboardBuffer.RemoveRange(0, System.Math.Min(used, keyboardBuffer.Count));
+
+            switch( ret.statusCode )
+            {
+                case 0: break;
+                case 1: break; //Idle, libkarv already skipped ahead to the next timer interrupt
+                case 3: Debug.Log("Tried to reset instct"); break;//instct = 0; break;
+                case 0x7777: Debug.Log("Tried to restart"); break;	//syscon code for restart
+                case 0x5555: Debug.Log("POWEROFF"); on = false; break;//printf( "POWEROFF@0x%08x%08x\n", core->cycleh, core->cyclel ); running = 0; break; //syscon code for power-off
+                default: Debug.Log( "Unknown failure" ); break;
             }
         }
 
@@ -198,7 +446,20 @@ namespace KARV
             
             if (initialized) {
                 uiImageObject.DestroyGameObject();
-                cleanup();
+                //This computer might be part of the running batch, libkarv must be done with it before it goes away
+                FinishBatch();
+                FinishSave(true);
+                activeComputers.Remove(this);
+                karv_destroy(karvContext);
+                karvContext = System.IntPtr.Zero;
+                if (activeComputers.Count == 0 && karvPool != System.IntPtr.Zero) {
+                    karv_pool_destroy(karvPool);
+                    karvPool = System.IntPtr.Zero;
+                }
+                if (activeComputers.Count == 0 && templateContext != System.IntPtr.Zero) {
+                    karv_destroy(templateContext);
+                    templateContext = System.IntPtr.Zero;
+                }
                 initialized = false;
             }
         }
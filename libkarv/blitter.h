@@ -0,0 +1,162 @@
+/*------------------------------------------------------------------------------*\
+ | blitter.h Copyright (c) 2025 StrandedSoftwareDeveloper under the MIT License |
+ | The guest's 2D blitter, responsibilities include:                            |
+ |  - The commands a guest puts in its blit lists                               |
+ |  - Clipping them to the screen and checking what they read is all in RAM     |
+ |  - Filling, copying and expanding 1 bit bitmaps in whatever format the       |
+ |    screen is in                                                              |
+ |                                                                              |
+ | Rows go through memcpy and memmove wherever they can, which move them with   |
+ | the widest stores the host has, so a whole rectangle costs about what the    |
+ | guest would pay for a handful of its own stores.                             |
+\*------------------------------------------------------------------------------*/
+
+#ifndef BLITTER_H
+#define BLITTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BLIT_END 0    //The list stops here
+#define BLIT_FILL 1   //Fills the rectangle with source, a pixel in the screen's format
+#define BLIT_COPY 2   //Copies pixels in the screen's format from source, which can overlap them in the framebuffer
+#define BLIT_EXPAND 3 //Draws a 1 bit bitmap at source (leftmost pixel in the high bit) in foreground and background
+
+#define BLIT_TRANSPARENT 1 //BLIT_EXPAND flag, 0 bits are left alone instead of drawn in background
+
+//One command of a blit list, 32 bytes in guest memory
+typedef struct {
+    uint32_t op;       //BLIT_*
+    uint32_t position; //Of the rectangle on screen, x in the low 16 bits and y in the high ones, both signed
+    uint32_t size;     //Width in the low 16 bits, height in the high ones
+    uint32_t source;   //The colour for BLIT_FILL, otherwise the guest address of the source's top left
+    uint32_t sourceStride; //Bytes from one row of the source to the next
+    uint32_t foreground;
+    uint32_t background;
+    uint32_t flags;    //BLIT_TRANSPARENT
+} BlitCommand;
+
+//What blits draw into, and the memory their sources are read from. pixels can be part of memory.
+typedef struct {
+    uint8_t *pixels; //Rows one after another
+    uint32_t width;
+    uint32_t height;
+    int bytesPerPixel;
+    const uint8_t *memory;
+    uint64_t memorySize;
+    uint32_t memoryBase; //The guest address memory starts at
+} BlitTarget;
+
+static inline void BlitPut(uint8_t *pixel, int bytesPerPixel, uint32_t val) {
+    switch (bytesPerPixel) {
+        case 1: *pixel = val; break;
+        case 2: *(uint16_t *)pixel = val; break;
+        default: *(uint32_t *)pixel = val; break;
+    }
+}
+
+//Fills height rows of width pixels, stride bytes apart, with colour
+static void BlitFill(uint8_t *dst, uint32_t stride, int bytesPerPixel, uint32_t width, uint32_t height, uint32_t colour) {
+    //One pixel, then the row doubles up from there, then every other row is a copy of the first
+    uint32_t rowBytes = width * bytesPerPixel;
+    BlitPut(dst, bytesPerPixel, colour);
+    for (uint32_t done = bytesPerPixel; done < rowBytes; done *= 2) {
+        memcpy(dst + done, dst, done < rowBytes - done ? done : rowBytes - done);
+    }
+    for (uint32_t y=1; y<height; y++) {
+        memcpy(dst + y * stride, dst, rowBytes);
+    }
+}
+
+//Copies height rows of rowBytes. src and dst may overlap, as long as their rows are the same distance apart.
+static void BlitCopy(uint8_t *dst, uint32_t dstStride, const uint8_t *src, uint32_t srcStride, uint32_t rowBytes,
+                     uint32_t height) {
+    if (dst > src) {
+        //Moving down, so bottom up keeps the rows still to be copied from being written over first
+        for (uint32_t y=height; y-- > 0; ) {
+            memmove(dst + y * dstStride, src + y * srcStride, rowBytes);
+        }
+    } else {
+        for (uint32_t y=0; y<height; y++) {
+            memmove(dst + y * dstStride, src + y * srcStride, rowBytes);
+        }
+    }
+}
+
+//Draws height rows of width bits, starting firstBit into each row of src
+static void BlitExpand(uint8_t *dst, uint32_t dstStride, int bytesPerPixel, const uint8_t *src, uint32_t srcStride,
+                       uint32_t firstBit, uint32_t width, uint32_t height, uint32_t foreground, uint32_t background,
+                       bool transparent) {
+    for (uint32_t y=0; y<height; y++) {
+        const uint8_t *bits = src + y * srcStride;
+        uint8_t *row = dst + y * dstStride;
+        for (uint32_t x=0; x<width; x++) {
+            uint32_t bit = firstBit + x;
+            bool set = (bits[bit >> 3] >> (7 - (bit & 7))) & 1;
+            if (set || !transparent) {
+                BlitPut(row + x * bytesPerPixel, bytesPerPixel, set ? foreground : background);
+            }
+        }
+    }
+}
+
+//Whether [ofs, ofs + len) of the guest's address space is all in memory
+static bool BlitInMemory(const BlitTarget *target, uint32_t address, uint64_t ofs, uint64_t len) {
+    uint64_t start = (uint64_t)(uint32_t)(address - target->memoryBase) + ofs;
+    return start <= target->memorySize && len <= target->memorySize - start;
+}
+
+//Runs cmd, clipped to the screen. Returns false if it isn't a command this knows or its source runs out of memory,
+//in which case nothing is drawn. Otherwise [*ofs, *ofs + *len) of pixels covers everything that may have changed.
+static bool BlitRun(const BlitTarget *target, const BlitCommand *cmd, uint32_t *ofs, uint32_t *len) {
+    *ofs = 0;
+    *len = 0;
+    if (cmd->op != BLIT_FILL && cmd->op != BLIT_COPY && cmd->op != BLIT_EXPAND) {
+        return false;
+    }
+    int32_t x = (int16_t)(cmd->position & 0xffff);
+    int32_t y = (int16_t)(cmd->position >> 16);
+    int32_t right = x + (int32_t)(cmd->size & 0xffff);
+    int32_t bottom = y + (int32_t)(cmd->size >> 16);
+    right = right < (int32_t)target->width ? right : (int32_t)target->width;
+    bottom = bottom < (int32_t)target->height ? bottom : (int32_t)target->height;
+    //How much of the source got clipped off the left and top
+    uint32_t skipX = x < 0 ? -x : 0;
+    uint32_t skipY = y < 0 ? -y : 0;
+    x += skipX;
+    y += skipY;
+    if (x >= right || y >= bottom) {
+        return true;
+    }
+    uint32_t width = right - x;
+    uint32_t height = bottom - y;
+    int bytesPerPixel = target->bytesPerPixel;
+    uint32_t stride = target->width * bytesPerPixel;
+    uint64_t srcStride = cmd->sourceStride;
+    uint8_t *dst = target->pixels + y * stride + x * bytesPerPixel;
+
+    if (cmd->op == BLIT_FILL) {
+        BlitFill(dst, stride, bytesPerPixel, width, height, cmd->source);
+    } else if (cmd->op == BLIT_COPY) {
+        uint64_t first = skipY * srcStride + (uint64_t)skipX * bytesPerPixel;
+        if (!BlitInMemory(target, cmd->source, first, (height - 1) * srcStride + (uint64_t)width * bytesPerPixel)) {
+            return false;
+        }
+        const uint8_t *src = target->memory + (uint32_t)(cmd->source - target->memoryBase) + first;
+        BlitCopy(dst, stride, src, cmd->sourceStride, width * bytesPerPixel, height);
+    } else {
+        uint64_t first = skipY * srcStride;
+        if (!BlitInMemory(target, cmd->source, first, (height - 1) * srcStride + (skipX + width + 7) / 8)) {
+            return false;
+        }
+        const uint8_t *src = target->memory + (uint32_t)(cmd->source - target->memoryBase) + first;
+        BlitExpand(dst, stride, bytesPerPixel, src, cmd->sourceStride, skipX, width, height, cmd->foreground,
+                   cmd->background, cmd->flags & BLIT_TRANSPARENT);
+    }
+    *ofs = dst - target->pixels;
+    *len = (height - 1) * stride + width * bytesPerPixel;
+    return true;
+}
+
+#endif
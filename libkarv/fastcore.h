@@ -0,0 +1,839 @@
+/*-------------------------------------------------------------------------------*\
+ | fastcore.h Copyright (c) 2025 StrandedSoftwareDeveloper under the MIT License |
+ | Predecoding execution engine for mini-rv32ima, responsibilities include:      |
+ |  - Decoding each guest page once into compact host-side instruction records   |
+ |  - Running those records with the same semantics as MiniRV32IMAStep           |
+ |  - Throwing decoded pages away when the guest stores to them                  |
+ |  - Threaded (computed goto) dispatch, one handler per decoded form            |
+ |  - Caching basic blocks by guest pc and chaining their static exits together  |
+ |  - Handing hot blocks to the x86-64 JIT in fastjit.h, where there is one      |
+ |                                                                               |
+ | Include it after mini-rv32ima.h (with MINIRV32_IMPLEMENTATION), it uses the   |
+ | same MINIRV32_* hooks and CSR()/REG() accessors. MINIRV32_POSTEXEC is ignored |
+\*-------------------------------------------------------------------------------*/
+
+#ifndef FASTCORE_H
+#define FASTCORE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Handed through to the MINIRV32_* hooks untouched, they see it as ctx
+#ifndef FASTCORE_CONTEXT_PARAM
+#define FASTCORE_CONTEXT_PARAM void *ctx
+#endif
+
+#define FC_PAGE_SHIFT 12
+#define FC_PAGE_SIZE (1 << FC_PAGE_SHIFT)
+#define FC_INSNS_PER_PAGE (FC_PAGE_SIZE / 4)
+
+//One entry per fully decoded instruction form
+typedef enum {
+    FC_ILLEGAL = 0,
+    FC_NOP,
+    FC_LUI,
+    FC_AUIPC,
+    FC_JAL,
+    FC_JALR,
+    FC_BEQ, FC_BNE, FC_BLT, FC_BGE, FC_BLTU, FC_BGEU,
+    FC_LB, FC_LH, FC_LW, FC_LBU, FC_LHU, FC_LOAD_ILLEGAL,
+    FC_SB, FC_SH, FC_SW, FC_STORE_ILLEGAL,
+    FC_ADDI, FC_SLTI, FC_SLTIU, FC_XORI, FC_ORI, FC_ANDI, FC_SLLI, FC_SRLI, FC_SRAI,
+    FC_ADD, FC_SUB, FC_SLL, FC_SLT, FC_SLTU, FC_XOR, FC_SRL, FC_SRA, FC_OR, FC_AND,
+    FC_MUL, FC_MULH, FC_MULHSU, FC_MULHU, FC_DIV, FC_DIVU, FC_REM, FC_REMU,
+    FC_CSRRW, FC_CSRRS, FC_CSRRC, FC_CSRRWI, FC_CSRRSI, FC_CSRRCI,
+    FC_ECALL, FC_EBREAK, FC_WFI, FC_MRET,
+    FC_LR, FC_SC, FC_AMOSWAP, FC_AMOADD, FC_AMOXOR, FC_AMOAND, FC_AMOOR,
+    FC_AMOMIN, FC_AMOMAX, FC_AMOMINU, FC_AMOMAXU, FC_AMO_ILLEGAL,
+    FC_NUM_OPS
+} FCOp;
+
+//A decoded instruction. Immediates are already sign extended, and anything
+//pc-relative (AUIPC, JAL and branch targets) is already an absolute address.
+//CSR instructions keep the CSR number in imm and the zimm in rs1.
+typedef struct {
+    uint8_t op;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint32_t imm;
+} FCInsn;
+
+//Native code for (a prefix of) a block, see fastjit.h for what it returns
+typedef uint64_t (*FCNativeBlock)(uint32_t *regs, uint8_t *image, void *pages, uint8_t *dirtyPages);
+
+//A straight run of records ending in a control transfer (or the end of its page).
+//Blocks never cross pages, so dropping a page only has to kill that page's blocks.
+typedef struct FCBlock {
+    uint32_t pc;
+    uint32_t len;
+    const FCInsn *insn;
+    struct FCBlock *next[2]; //Chained successors, [0] is the jump/branch target and [1] the fall through
+    struct FCBlock *nextInPage;
+    FCNativeBlock native; //NULL until the block gets hot enough to compile
+    uint32_t hits;
+    uint8_t valid;
+} FCBlock;
+
+typedef struct FCPage {
+    FCInsn insn[FC_INSNS_PER_PAGE];
+    FCBlock *blocks; //Every block built out of this page
+    struct FCPage *nextFree;
+} FCPage;
+
+//x86-64 hosts get a JIT for hot blocks, build with -DFASTCORE_NO_JIT to leave everything to the interpreter
+#if !defined(FASTCORE_NO_JIT) && (defined(__x86_64__) || defined(_M_X64))
+#define FASTCORE_JIT 1
+#include "fastjit.h"
+#else
+#define FASTCORE_JIT 0
+#endif
+
+//Times a block has to be entered before it gets compiled
+#ifndef FASTCORE_JIT_THRESHOLD
+#define FASTCORE_JIT_THRESHOLD 64
+#endif
+
+#define FC_BLOCK_HASH_SIZE (1 << 15)
+#define FC_MAX_BLOCKS (1 << 15)
+
+typedef struct {
+    FCPage **pages; //Indexed by guest RAM page, NULL if not decoded
+    uint32_t numPages;
+    uint8_t *dirtyPages; //The embedder's, see FastCoreInit
+    FCPage *freePages;
+
+    FCBlock **blockHash; //Direct mapped by pc, a collision just means the block gets built again
+    FCBlock *blocks; //Bump allocated, only reclaimed all at once by FastCoreFlush
+    uint32_t numBlocks;
+
+#if FASTCORE_JIT
+    FastJit jit;
+#endif
+} FastCore;
+
+//dirtyPages has a byte per page of RAM, compiled stores set theirs to 0xff. Stores the interpreter runs only mark it
+//if the embedder's MINIRV32_STORE* do, so it should cover those too.
+static void FastCoreInit(FastCore *fc, uint32_t ramSize, uint8_t *dirtyPages) {
+    fc->numPages = ramSize >> FC_PAGE_SHIFT;
+    fc->dirtyPages = dirtyPages;
+    fc->pages = calloc(fc->numPages, sizeof(FCPage *));
+    fc->freePages = NULL;
+    fc->blockHash = calloc(FC_BLOCK_HASH_SIZE, sizeof(FCBlock *));
+    fc->blocks = malloc(FC_MAX_BLOCKS * sizeof(FCBlock));
+    fc->numBlocks = 0;
+#if FASTCORE_JIT
+    FastJitInit(&fc->jit);
+#endif
+}
+
+static void FastCoreFree(FastCore *fc) {
+    for (uint32_t i=0; i<fc->numPages; i++) {
+        free(fc->pages[i]);
+    }
+    while (fc->freePages != NULL) {
+        FCPage *next = fc->freePages->nextFree;
+        free(fc->freePages);
+        fc->freePages = next;
+    }
+    free(fc->pages);
+    fc->pages = NULL;
+    free(fc->blockHash);
+    free(fc->blocks);
+#if FASTCORE_JIT
+    FastJitFree(&fc->jit);
+#endif
+}
+
+//Drops the decoded copy of a page and every block built from it, call this whenever guest RAM changes under the emulator
+static void FastCoreInvalidatePage(FastCore *fc, uint32_t pageIndex) {
+    FCPage *page = fc->pages[pageIndex];
+    if (page != NULL) {
+        for (FCBlock *block = page->blocks; block != NULL; block = block->nextInPage) {
+            block->valid = 0;
+        }
+        fc->pages[pageIndex] = NULL;
+        page->nextFree = fc->freePages;
+        fc->freePages = page;
+    }
+}
+
+//Throws away everything, used when the block arena (or the JIT's code arena) fills up
+static void FastCoreFlush(FastCore *fc) {
+    for (uint32_t i=0; i<fc->numPages; i++) {
+        FastCoreInvalidatePage(fc, i);
+    }
+    memset(fc->blockHash, 0, FC_BLOCK_HASH_SIZE * sizeof(FCBlock *));
+    fc->numBlocks = 0;
+#if FASTCORE_JIT
+    FastJitReset(&fc->jit);
+#endif
+}
+
+//Mirrors the decoding done by MiniRV32IMAStep, quirks included, so both engines agree on every encoding
+static void FastCoreDecode(uint32_t ir, uint32_t pc, FCInsn *out) {
+    uint32_t rd = (ir >> 7) & 0x1f;
+    uint32_t funct3 = (ir >> 12) & 0x7;
+    uint32_t immI = ir >> 20;
+    immI |= (immI & 0x800) ? 0xfffff000 : 0;
+
+    out->op = FC_ILLEGAL;
+    out->rd = rd;
+    out->rs1 = (ir >> 15) & 0x1f;
+    out->rs2 = (ir >> 20) & 0x1f;
+    out->imm = 0;
+
+    switch (ir & 0x7f) {
+        case 0x37: { //LUI
+            out->op = rd ? FC_LUI : FC_NOP;
+            out->imm = ir & 0xfffff000;
+            break;
+        }
+        case 0x17: { //AUIPC
+            out->op = rd ? FC_AUIPC : FC_NOP;
+            out->imm = pc + (ir & 0xfffff000);
+            break;
+        }
+        case 0x6F: { //JAL
+            int32_t reladdy = ((ir & 0x80000000)>>11) | ((ir & 0x7fe00000)>>20) | ((ir & 0x00100000)>>9) | ((ir&0x000ff000));
+            if (reladdy & 0x00100000) reladdy |= 0xffe00000;
+            out->op = FC_JAL;
+            out->imm = pc + reladdy;
+            break;
+        }
+        case 0x67: { //JALR
+            out->op = FC_JALR;
+            out->imm = immI;
+            break;
+        }
+        case 0x63: { //Branch
+            static const uint8_t branchOps[8] = { FC_BEQ, FC_BNE, FC_ILLEGAL, FC_ILLEGAL, FC_BLT, FC_BGE, FC_BLTU, FC_BGEU };
+            uint32_t immm4 = ((ir & 0xf00)>>7) | ((ir & 0x7e000000)>>20) | ((ir & 0x80) << 4) | ((ir >> 31)<<12);
+            if (immm4 & 0x1000) immm4 |= 0xffffe000;
+            out->op = branchOps[funct3];
+            out->imm = pc + immm4;
+            break;
+        }
+        case 0x03: { //Load
+            static const uint8_t loadOps[8] = { FC_LB, FC_LH, FC_LW, FC_LOAD_ILLEGAL, FC_LBU, FC_LHU, FC_LOAD_ILLEGAL, FC_LOAD_ILLEGAL };
+            out->op = loadOps[funct3];
+            out->imm = immI;
+            break;
+        }
+        case 0x23: { //Store
+            static const uint8_t storeOps[8] = { FC_SB, FC_SH, FC_SW, FC_STORE_ILLEGAL, FC_STORE_ILLEGAL, FC_STORE_ILLEGAL, FC_STORE_ILLEGAL, FC_STORE_ILLEGAL };
+            uint32_t addy = ((ir >> 7) & 0x1f) | ((ir & 0xfe000000) >> 20);
+            if (addy & 0x800) addy |= 0xfffff000;
+            out->op = storeOps[funct3];
+            out->rd = 0;
+            out->imm = addy;
+            break;
+        }
+        case 0x13: { //Op-immediate
+            static const uint8_t immOps[8] = { FC_ADDI, FC_SLLI, FC_SLTI, FC_SLTIU, FC_XORI, FC_SRLI, FC_ORI, FC_ANDI };
+            out->op = immOps[funct3];
+            if (funct3 == 5 && (ir & 0x40000000)) out->op = FC_SRAI;
+            out->imm = (funct3 == 1 || funct3 == 5) ? (immI & 0x1f) : immI;
+            if (rd == 0) out->op = FC_NOP;
+            break;
+        }
+        case 0x33: { //Op
+            static const uint8_t regOps[8] = { FC_ADD, FC_SLL, FC_SLT, FC_SLTU, FC_XOR, FC_SRL, FC_OR, FC_AND };
+            static const uint8_t mulOps[8] = { FC_MUL, FC_MULH, FC_MULHSU, FC_MULHU, FC_DIV, FC_DIVU, FC_REM, FC_REMU };
+            if (ir & 0x02000000) {
+                out->op = mulOps[funct3];
+            } else {
+                out->op = regOps[funct3];
+                if (funct3 == 0 && (ir & 0x40000000)) out->op = FC_SUB;
+                if (funct3 == 5 && (ir & 0x40000000)) out->op = FC_SRA;
+            }
+            if (rd == 0) out->op = FC_NOP;
+            break;
+        }
+        case 0x0f: { //Fence, ignored just like MiniRV32IMAStep
+            out->op = FC_NOP;
+            break;
+        }
+        case 0x73: { //Zifencei+Zicsr
+            static const uint8_t csrOps[8] = { FC_ILLEGAL, FC_CSRRW, FC_CSRRS, FC_CSRRC, FC_ILLEGAL, FC_CSRRWI, FC_CSRRSI, FC_CSRRCI };
+            uint32_t csrno = ir >> 20;
+            out->imm = csrno;
+            if (funct3 != 0) {
+                out->op = csrOps[funct3];
+            } else if (csrno == 0x105) {
+                out->op = FC_WFI;
+            } else if ((csrno & 0xff) == 0x02) {
+                out->op = FC_MRET;
+            } else if (csrno == 0) {
+                out->op = FC_ECALL;
+            } else if (csrno == 1) {
+                out->op = FC_EBREAK;
+            }
+            break;
+        }
+        case 0x2f: { //RV32A
+            switch ((ir >> 27) & 0x1f) {
+                case 2: out->op = FC_LR; break;
+                case 3: out->op = FC_SC; break;
+                case 1: out->op = FC_AMOSWAP; break;
+                case 0: out->op = FC_AMOADD; break;
+                case 4: out->op = FC_AMOXOR; break;
+                case 12: out->op = FC_AMOAND; break;
+                case 8: out->op = FC_AMOOR; break;
+                case 16: out->op = FC_AMOMIN; break;
+                case 20: out->op = FC_AMOMAX; break;
+                case 24: out->op = FC_AMOMINU; break;
+                case 28: out->op = FC_AMOMAXU; break;
+                default: out->op = FC_AMO_ILLEGAL; break;
+            }
+            break;
+        }
+    }
+}
+
+static FCPage *FastCoreDecodePage(FastCore *fc, const uint8_t *image, uint32_t pageIndex) {
+    FCPage *page = fc->freePages;
+    if (page != NULL) {
+        fc->freePages = page->nextFree;
+    } else {
+        page = malloc(sizeof(FCPage));
+    }
+
+    page->blocks = NULL;
+
+    const uint32_t *words = (const uint32_t *)(image + (pageIndex << FC_PAGE_SHIFT));
+    uint32_t pc = (pageIndex << FC_PAGE_SHIFT) + MINIRV32_RAM_IMAGE_OFFSET;
+    for (int i=0; i<FC_INSNS_PER_PAGE; i++) {
+        FastCoreDecode(words[i], pc + i*4, &page->insn[i]);
+    }
+
+    fc->pages[pageIndex] = page;
+    return page;
+}
+
+static int FastCoreEndsBlock(uint8_t op) {
+    switch (op) {
+        case FC_JAL: case FC_JALR:
+        case FC_BEQ: case FC_BNE: case FC_BLT: case FC_BGE: case FC_BLTU: case FC_BGEU:
+        case FC_ECALL: case FC_EBREAK: case FC_WFI: case FC_MRET:
+        case FC_ILLEGAL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+//Finds or builds the block starting at ofs_pc, which has to be a valid, aligned RAM offset.
+//If chainFrom is given the result is also remembered there, unless building it flushed the cache.
+static FCBlock *FastCoreLookupBlock(FastCore *fc, uint8_t *image, uint32_t ofs_pc, FCBlock **chainFrom) {
+    uint32_t pc = ofs_pc + MINIRV32_RAM_IMAGE_OFFSET;
+    FCBlock **hashSlot = &fc->blockHash[(pc >> 2) & (FC_BLOCK_HASH_SIZE-1)];
+    FCBlock *block = *hashSlot;
+    if (block != NULL && block->pc == pc && block->valid) {
+        if (chainFrom != NULL) *chainFrom = block;
+        return block;
+    }
+
+    if (fc->numBlocks == FC_MAX_BLOCKS) {
+        FastCoreFlush(fc);
+        chainFrom = NULL;
+    }
+
+    FCPage *page = fc->pages[ofs_pc >> FC_PAGE_SHIFT];
+    if (page == NULL) {
+        page = FastCoreDecodePage(fc, image, ofs_pc >> FC_PAGE_SHIFT);
+    }
+
+    const uint32_t slot = (ofs_pc >> 2) & (FC_INSNS_PER_PAGE-1);
+    uint32_t len = 0;
+    while (slot + len < FC_INSNS_PER_PAGE) {
+        len++;
+        if (FastCoreEndsBlock(page->insn[slot + len - 1].op)) {
+            break;
+        }
+    }
+
+    block = &fc->blocks[fc->numBlocks++];
+    block->pc = pc;
+    block->len = len;
+    block->insn = &page->insn[slot];
+    block->next[0] = NULL;
+    block->next[1] = NULL;
+    block->native = NULL;
+    block->hits = 0;
+    block->valid = 1;
+    block->nextInPage = page->blocks;
+    page->blocks = block;
+
+    *hashSlot = block;
+    if (chainFrom != NULL) *chainFrom = block;
+    return block;
+}
+
+//Called on every guest store to RAM, ofs is relative to the start of RAM
+#define FC_STORE_HITS_CODE( ofs, len ) ( fc->pages[(ofs) >> FC_PAGE_SHIFT] || fc->pages[((ofs) + (len) - 1) >> FC_PAGE_SHIFT] )
+#define FC_INVALIDATE_STORE( ofs, len ) \
+    if (FC_STORE_HITS_CODE( ofs, len )) { \
+        FastCoreInvalidatePage(fc, (ofs) >> FC_PAGE_SHIFT); \
+        FastCoreInvalidatePage(fc, ((ofs) + (len) - 1) >> FC_PAGE_SHIFT); \
+        if (!block->valid) FC_EXIT_SMC(); \
+    }
+
+//Zicsr accesses, kept out of line since they are rare compared to everything else
+static uint32_t FastCoreReadCSR(FASTCORE_CONTEXT_PARAM, struct MiniRV32IMAState * state, uint8_t * image, uint32_t csrno, uint32_t cycle) {
+    uint32_t rval = 0;
+    switch( csrno )
+    {
+    case 0x340: rval = CSR( mscratch ); break;
+    case 0x305: rval = CSR( mtvec ); break;
+    case 0x304: rval = CSR( mie ); break;
+    case 0xC00: rval = cycle; break;
+    case 0x344: rval = CSR( mip ); break;
+    case 0x341: rval = CSR( mepc ); break;
+    case 0x300: rval = CSR( mstatus ); break; //mstatus
+    case 0x342: rval = CSR( mcause ); break;
+    case 0x343: rval = CSR( mtval ); break;
+    case 0xf11: rval = 0xff0ff0ff; break; //mvendorid
+    case 0x301: rval = 0x40401101; break; //misa (XLEN=32, IMA+X)
+    default:
+        MINIRV32_OTHERCSR_READ( csrno, rval );
+        break;
+    }
+    return rval;
+}
+
+static void FastCoreWriteCSR(FASTCORE_CONTEXT_PARAM, struct MiniRV32IMAState * state, uint8_t * image, uint32_t csrno, uint32_t writeval) {
+    switch( csrno )
+    {
+    case 0x340: SETCSR( mscratch, writeval ); break;
+    case 0x305: SETCSR( mtvec, writeval ); break;
+    case 0x304: SETCSR( mie, writeval ); break;
+    case 0x344: SETCSR( mip, writeval ); break;
+    case 0x341: SETCSR( mepc, writeval ); break;
+    case 0x300: SETCSR( mstatus, writeval ); break; //mstatus
+    case 0x342: SETCSR( mcause, writeval ); break;
+    case 0x343: SETCSR( mtval, writeval ); break;
+    default:
+        MINIRV32_OTHERCSR_WRITE( csrno, writeval );
+        break;
+    }
+}
+
+//Computed goto dispatch (one indirect jump at the end of every handler) where the compiler supports it,
+//build with -DFASTCORE_NO_THREADED_DISPATCH to fall back to a plain switch
+#if !defined(FASTCORE_NO_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__) || defined(__TINYC__))
+#define FASTCORE_THREADED 1
+#else
+#define FASTCORE_THREADED 0
+#endif
+
+//Inside a block pc is not kept up to date, these recover it (and the instruction count) from the record pointer
+#define FC_PC() ( blockPc + (uint32_t)((in - blockStart) << 2) )
+#define FC_RETIRED() ( (int)(in - blockStart) + 1 )
+
+#if FASTCORE_THREADED
+#define FC_OP( name ) op_##name:
+#define FC_BEGIN_DISPATCH() rs1 = REG( in->rs1 ); rs2 = REG( in->rs2 ); goto *fcHandlers[in->op];
+#define FC_CONTINUE() { if (++in == blockStop) goto blockFallthrough; rs1 = REG( in->rs1 ); rs2 = REG( in->rs2 ); goto *fcHandlers[in->op]; }
+#define FC_END_DISPATCH()
+#else
+#define FC_OP( name ) case name:
+#define FC_BEGIN_DISPATCH() for (;;) { rs1 = REG( in->rs1 ); rs2 = REG( in->rs2 ); switch (in->op) {
+#define FC_CONTINUE() { if (++in == blockStop) goto blockFallthrough; continue; }
+#define FC_END_DISPATCH() default: FC_TRAP( 2+1 ); } }
+#endif
+
+//Leaves the block after the current instruction, exitSlot picks which chain pointer to follow (-1 for dynamic targets)
+#define FC_EXIT( target, slot ) { pc = (target); exitSlot = (slot); goto blockExit; }
+#define FC_TRAP( code ) { trap = (code); pc = FC_PC(); icount += FC_RETIRED(); cycle += FC_RETIRED(); goto exitLoop; }
+//The current instruction stored over its own block, finish it and look everything up again
+#define FC_EXIT_SMC() { pc = FC_PC() + 4; exitSlot = -1; goto blockExit; }
+
+//Same contract as MiniRV32IMAStep, but runs cached blocks of predecoded records. cycle and numRun are only
+//brought up to date when a block is left, and at most count instructions run (a block gets cut short if needed).
+static int32_t MiniRV32IMAStepCached(FastCore *fc, FASTCORE_CONTEXT_PARAM, struct MiniRV32IMAState * state, uint8_t * image, uint32_t vProcAddress, uint32_t elapsedUs, int count, int *numRun) {
+    (void)vProcAddress; //Only there to match MiniRV32IMAStep, neither uses it
+#if FASTCORE_THREADED
+    static const void *const fcHandlers[FC_NUM_OPS] = {
+        [FC_ILLEGAL] = &&op_FC_ILLEGAL, [FC_NOP] = &&op_FC_NOP, [FC_LUI] = &&op_FC_LUI, [FC_AUIPC] = &&op_FC_AUIPC,
+        [FC_JAL] = &&op_FC_JAL, [FC_JALR] = &&op_FC_JALR,
+        [FC_BEQ] = &&op_FC_BEQ, [FC_BNE] = &&op_FC_BNE, [FC_BLT] = &&op_FC_BLT, [FC_BGE] = &&op_FC_BGE, [FC_BLTU] = &&op_FC_BLTU, [FC_BGEU] = &&op_FC_BGEU,
+        [FC_LB] = &&op_FC_LB, [FC_LH] = &&op_FC_LH, [FC_LW] = &&op_FC_LW, [FC_LBU] = &&op_FC_LBU, [FC_LHU] = &&op_FC_LHU, [FC_LOAD_ILLEGAL] = &&op_FC_LOAD_ILLEGAL,
+        [FC_SB] = &&op_FC_SB, [FC_SH] = &&op_FC_SH, [FC_SW] = &&op_FC_SW, [FC_STORE_ILLEGAL] = &&op_FC_STORE_ILLEGAL,
+        [FC_ADDI] = &&op_FC_ADDI, [FC_SLTI] = &&op_FC_SLTI, [FC_SLTIU] = &&op_FC_SLTIU, [FC_XORI] = &&op_FC_XORI, [FC_ORI] = &&op_FC_ORI,
+        [FC_ANDI] = &&op_FC_ANDI, [FC_SLLI] = &&op_FC_SLLI, [FC_SRLI] = &&op_FC_SRLI, [FC_SRAI] = &&op_FC_SRAI,
+        [FC_ADD] = &&op_FC_ADD, [FC_SUB] = &&op_FC_SUB, [FC_SLL] = &&op_FC_SLL, [FC_SLT] = &&op_FC_SLT, [FC_SLTU] = &&op_FC_SLTU,
+        [FC_XOR] = &&op_FC_XOR, [FC_SRL] = &&op_FC_SRL, [FC_SRA] = &&op_FC_SRA, [FC_OR] = &&op_FC_OR, [FC_AND] = &&op_FC_AND,
+        [FC_MUL] = &&op_FC_MUL, [FC_MULH] = &&op_FC_MULH, [FC_MULHSU] = &&op_FC_MULHSU, [FC_MULHU] = &&op_FC_MULHU,
+        [FC_DIV] = &&op_FC_DIV, [FC_DIVU] = &&op_FC_DIVU, [FC_REM] = &&op_FC_REM, [FC_REMU] = &&op_FC_REMU,
+        [FC_CSRRW] = &&op_FC_CSRRW, [FC_CSRRS] = &&op_FC_CSRRS, [FC_CSRRC] = &&op_FC_CSRRC,
+        [FC_CSRRWI] = &&op_FC_CSRRWI, [FC_CSRRSI] = &&op_FC_CSRRSI, [FC_CSRRCI] = &&op_FC_CSRRCI,
+        [FC_ECALL] = &&op_FC_ECALL, [FC_EBREAK] = &&op_FC_EBREAK, [FC_WFI] = &&op_FC_WFI, [FC_MRET] = &&op_FC_MRET,
+        [FC_LR] = &&op_FC_LR, [FC_SC] = &&op_FC_SC, [FC_AMOSWAP] = &&op_FC_AMOSWAP, [FC_AMOADD] = &&op_FC_AMOADD,
+        [FC_AMOXOR] = &&op_FC_AMOXOR, [FC_AMOAND] = &&op_FC_AMOAND, [FC_AMOOR] = &&op_FC_AMOOR,
+        [FC_AMOMIN] = &&op_FC_AMOMIN, [FC_AMOMAX] = &&op_FC_AMOMAX, [FC_AMOMINU] = &&op_FC_AMOMINU, [FC_AMOMAXU] = &&op_FC_AMOMAXU,
+        [FC_AMO_ILLEGAL] = &&op_FC_AMO_ILLEGAL,
+    };
+#endif
+
+    uint32_t new_timer = CSR( timerl ) + elapsedUs;
+    if( new_timer < CSR( timerl ) ) CSR( timerh )++;
+    CSR( timerl ) = new_timer;
+
+    // Handle Timer interrupt.
+    if( ( CSR( timerh ) > CSR( timermatchh ) || ( CSR( timerh ) == CSR( timermatchh ) && CSR( timerl ) > CSR( timermatchl ) ) ) && ( CSR( timermatchh ) || CSR( timermatchl ) ) )
+    {
+        CSR( extraflags ) &= ~4; // Clear WFI
+        CSR( mip ) |= 1<<7; //MTIP of MIP
+    }
+    else
+        CSR( mip ) &= ~(1<<7);
+
+    // If WFI, don't run processor.
+    if( CSR( extraflags ) & 4 )
+        return 1;
+
+    uint32_t trap = 0;
+    uint32_t rval = 0;
+    uint32_t pc = CSR( pc );
+    uint32_t cycle = CSR( cyclel );
+
+    int icount = 0;
+    int exitSlot = -1;
+    uint32_t ofs_pc, rs1, rs2, addy, wval, blockPc;
+    FCBlock *block = NULL;
+    const FCInsn *in, *blockStart, *blockStop;
+
+    if( ( CSR( mip ) & (1<<7) ) && ( CSR( mie ) & (1<<7) /*mtie*/ ) && ( CSR( mstatus ) & 0x8 /*mie*/) )
+    {
+        // Timer interrupt.
+        trap = 0x80000007;
+        pc -= 4;
+        goto handleTrap;
+    }
+
+nextBlock:
+    if (icount >= count) goto exitLoop;
+    ofs_pc = pc - MINIRV32_RAM_IMAGE_OFFSET;
+    if( ofs_pc >= MINI_RV32_RAM_SIZE )
+    {
+        icount++;
+        cycle++;
+        trap = 1 + 1;  // Handle access violation on instruction read.
+        goto exitLoop;
+    }
+    else if( ofs_pc & 3 )
+    {
+        icount++;
+        cycle++;
+        trap = 1 + 0;  //Handle PC-misaligned access
+        goto exitLoop;
+    }
+
+    if (block != NULL && exitSlot >= 0) {
+        FCBlock *chained = block->next[exitSlot];
+        if (chained != NULL && chained->valid) {
+            block = chained;
+        } else {
+            block = FastCoreLookupBlock(fc, image, ofs_pc, block->valid ? &block->next[exitSlot] : NULL);
+        }
+    } else {
+        block = FastCoreLookupBlock(fc, image, ofs_pc, NULL);
+    }
+
+    blockPc = pc;
+    blockStart = block->insn;
+    blockStop = blockStart + ((uint32_t)(count - icount) < block->len ? (uint32_t)(count - icount) : block->len);
+    in = blockStart;
+
+#if FASTCORE_JIT
+    if (block->native == NULL && ++block->hits == FASTCORE_JIT_THRESHOLD) {
+        if (FastJitHasRoom(&fc->jit, block)) {
+            block->native = (FCNativeBlock)FastJitCompile(&fc->jit, block);
+        } else if (fc->jit.code != NULL) {
+            //Out of code space, start over (this block's records stay readable until the next lookup)
+            FastCoreFlush(fc);
+        }
+    }
+    if (block->native != NULL && block->len <= (uint32_t)(count - icount)) {
+        uint64_t result = block->native(state->regs, image, fc->pages, fc->dirtyPages);
+        uint32_t finished = (uint32_t)result & 0xffff;
+        uint32_t kind = ((uint32_t)result >> 16) & 3;
+        if (kind != FJ_EXIT_SIDE) {
+            icount += finished;
+            cycle += finished;
+            pc = (uint32_t)(result >> 32);
+            exitSlot = (kind == FJ_EXIT_DYNAMIC) ? -1 : (int)kind - 1;
+            goto nextBlock;
+        }
+        //Interpret the rest of the block starting with the record the native code couldn't do
+        in += finished;
+    }
+#endif
+
+    FC_BEGIN_DISPATCH()
+
+    FC_OP( FC_NOP ) FC_CONTINUE();
+    FC_OP( FC_LUI ) REGSET( in->rd, in->imm ); FC_CONTINUE();
+    FC_OP( FC_AUIPC ) REGSET( in->rd, in->imm ); FC_CONTINUE();
+    FC_OP( FC_JAL ) {
+        if (in->rd) REGSET( in->rd, FC_PC() + 4 );
+        FC_EXIT( in->imm, 0 );
+    }
+    FC_OP( FC_JALR ) {
+        if (in->rd) REGSET( in->rd, FC_PC() + 4 );
+        FC_EXIT( (rs1 + in->imm) & ~1, -1 );
+    }
+
+    FC_OP( FC_BEQ ) if (rs1 == rs2) FC_EXIT( in->imm, 0 ) else FC_EXIT( FC_PC() + 4, 1 );
+    FC_OP( FC_BNE ) if (rs1 != rs2) FC_EXIT( in->imm, 0 ) else FC_EXIT( FC_PC() + 4, 1 );
+    FC_OP( FC_BLT ) if ((int32_t)rs1 < (int32_t)rs2) FC_EXIT( in->imm, 0 ) else FC_EXIT( FC_PC() + 4, 1 );
+    FC_OP( FC_BGE ) if ((int32_t)rs1 >= (int32_t)rs2) FC_EXIT( in->imm, 0 ) else FC_EXIT( FC_PC() + 4, 1 );
+    FC_OP( FC_BLTU ) if (rs1 < rs2) FC_EXIT( in->imm, 0 ) else FC_EXIT( FC_PC() + 4, 1 );
+    FC_OP( FC_BGEU ) if (rs1 >= rs2) FC_EXIT( in->imm, 0 ) else FC_EXIT( FC_PC() + 4, 1 );
+
+//Loads and stores that miss RAM go to the CLNT/UART/etc. exactly like in MiniRV32IMAStep, whatever their width
+#define FC_LOAD( loadExpr ) { \
+        addy = rs1 + in->imm - MINIRV32_RAM_IMAGE_OFFSET; \
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) goto loadControl; \
+        rval = loadExpr; \
+        if (in->rd) REGSET( in->rd, rval ); \
+        FC_CONTINUE(); \
+    }
+    FC_OP( FC_LB ) FC_LOAD( MINIRV32_LOAD1_SIGNED( addy ) );
+    FC_OP( FC_LH ) FC_LOAD( MINIRV32_LOAD2_SIGNED( addy ) );
+    FC_OP( FC_LW ) FC_LOAD( MINIRV32_LOAD4( addy ) );
+    FC_OP( FC_LBU ) FC_LOAD( MINIRV32_LOAD1( addy ) );
+    FC_OP( FC_LHU ) FC_LOAD( MINIRV32_LOAD2( addy ) );
+    FC_OP( FC_LOAD_ILLEGAL ) {
+        addy = rs1 + in->imm - MINIRV32_RAM_IMAGE_OFFSET;
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) goto loadControl;
+        FC_TRAP( 2+1 );
+    }
+    loadControl: {
+        addy += MINIRV32_RAM_IMAGE_OFFSET;
+        if( addy >= 0x10000000 && addy < 0x12000000 )  // UART, CLNT
+        {
+            if( addy == 0x1100bffc ) // https://chromitem-soc.readthedocs.io/en/latest/clint.html
+                rval = CSR( timerh );
+            else if( addy == 0x1100bff8 )
+                rval = CSR( timerl );
+            else
+                MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval );
+        }
+        else
+        {
+            rval = addy;
+            FC_TRAP( 5+1 );
+        }
+        if (in->rd) REGSET( in->rd, rval );
+        FC_CONTINUE();
+    }
+
+#define FC_STORE( len, storeStmt ) { \
+        addy = rs1 + in->imm - MINIRV32_RAM_IMAGE_OFFSET; \
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) goto storeControl; \
+        storeStmt; \
+        FC_INVALIDATE_STORE( addy, len ); \
+        FC_CONTINUE(); \
+    }
+    FC_OP( FC_SB ) FC_STORE( 1, MINIRV32_STORE1( addy, rs2 ) );
+    FC_OP( FC_SH ) FC_STORE( 2, MINIRV32_STORE2( addy, rs2 ) );
+    FC_OP( FC_SW ) FC_STORE( 4, MINIRV32_STORE4( addy, rs2 ) );
+    FC_OP( FC_STORE_ILLEGAL ) {
+        addy = rs1 + in->imm - MINIRV32_RAM_IMAGE_OFFSET;
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) goto storeControl;
+        FC_TRAP( 2+1 );
+    }
+    storeControl: {
+        addy += MINIRV32_RAM_IMAGE_OFFSET;
+        if( addy >= 0x10000000 && addy < 0x12000000 )
+        {
+            // Should be stuff like SYSCON, 8250, CLNT
+            if( addy == 0x11004004 ) //CLNT
+                CSR( timermatchh ) = rs2;
+            else if( addy == 0x11004000 ) //CLNT
+                CSR( timermatchl ) = rs2;
+            else if( addy == 0x11100000 ) //SYSCON (reboot, poweroff, etc.)
+            {
+                *numRun = icount + FC_RETIRED();
+                SETCSR( pc, FC_PC() + 4 );
+                return rs2; // NOTE: PC will be PC of Syscon.
+            }
+            else
+            {
+                *numRun = icount + FC_RETIRED();
+                MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, rs2 );
+                //Some of these write RAM for the guest (the framebuffer window, the blitter), maybe over this block
+                if (!block->valid) FC_EXIT_SMC();
+            }
+        }
+        else
+        {
+            rval = addy;
+            FC_TRAP( 7+1 ); // Store access fault.
+        }
+        FC_CONTINUE();
+    }
+
+    FC_OP( FC_ADDI ) REGSET( in->rd, rs1 + in->imm ); FC_CONTINUE();
+    FC_OP( FC_SLTI ) REGSET( in->rd, (int32_t)rs1 < (int32_t)in->imm ); FC_CONTINUE();
+    FC_OP( FC_SLTIU ) REGSET( in->rd, rs1 < in->imm ); FC_CONTINUE();
+    FC_OP( FC_XORI ) REGSET( in->rd, rs1 ^ in->imm ); FC_CONTINUE();
+    FC_OP( FC_ORI ) REGSET( in->rd, rs1 | in->imm ); FC_CONTINUE();
+    FC_OP( FC_ANDI ) REGSET( in->rd, rs1 & in->imm ); FC_CONTINUE();
+    FC_OP( FC_SLLI ) REGSET( in->rd, rs1 << in->imm ); FC_CONTINUE();
+    FC_OP( FC_SRLI ) REGSET( in->rd, rs1 >> in->imm ); FC_CONTINUE();
+    FC_OP( FC_SRAI ) REGSET( in->rd, ((int32_t)rs1) >> in->imm ); FC_CONTINUE();
+
+    FC_OP( FC_ADD ) REGSET( in->rd, rs1 + rs2 ); FC_CONTINUE();
+    FC_OP( FC_SUB ) REGSET( in->rd, rs1 - rs2 ); FC_CONTINUE();
+    FC_OP( FC_SLL ) REGSET( in->rd, rs1 << (rs2 & 0x1F) ); FC_CONTINUE();
+    FC_OP( FC_SLT ) REGSET( in->rd, (int32_t)rs1 < (int32_t)rs2 ); FC_CONTINUE();
+    FC_OP( FC_SLTU ) REGSET( in->rd, rs1 < rs2 ); FC_CONTINUE();
+    FC_OP( FC_XOR ) REGSET( in->rd, rs1 ^ rs2 ); FC_CONTINUE();
+    FC_OP( FC_SRL ) REGSET( in->rd, rs1 >> (rs2 & 0x1F) ); FC_CONTINUE();
+    FC_OP( FC_SRA ) REGSET( in->rd, ((int32_t)rs1) >> (rs2 & 0x1F) ); FC_CONTINUE();
+    FC_OP( FC_OR ) REGSET( in->rd, rs1 | rs2 ); FC_CONTINUE();
+    FC_OP( FC_AND ) REGSET( in->rd, rs1 & rs2 ); FC_CONTINUE();
+
+    FC_OP( FC_MUL ) REGSET( in->rd, rs1 * rs2 ); FC_CONTINUE();
+    FC_OP( FC_MULH ) REGSET( in->rd, ((int64_t)((int32_t)rs1) * (int64_t)((int32_t)rs2)) >> 32 ); FC_CONTINUE();
+    FC_OP( FC_MULHSU ) REGSET( in->rd, ((int64_t)((int32_t)rs1) * (uint64_t)rs2) >> 32 ); FC_CONTINUE();
+    FC_OP( FC_MULHU ) REGSET( in->rd, ((uint64_t)rs1 * (uint64_t)rs2) >> 32 ); FC_CONTINUE();
+    FC_OP( FC_DIV ) REGSET( in->rd, (rs2 == 0) ? 0xffffffff : ((int32_t)rs1 == INT32_MIN && (int32_t)rs2 == -1) ? rs1 : (uint32_t)((int32_t)rs1 / (int32_t)rs2) ); FC_CONTINUE();
+    FC_OP( FC_DIVU ) REGSET( in->rd, (rs2 == 0) ? 0xffffffff : rs1 / rs2 ); FC_CONTINUE();
+    FC_OP( FC_REM ) REGSET( in->rd, (rs2 == 0) ? rs1 : ((int32_t)rs1 == INT32_MIN && (int32_t)rs2 == -1) ? 0 : (uint32_t)((int32_t)rs1 % (int32_t)rs2) ); FC_CONTINUE();
+    FC_OP( FC_REMU ) REGSET( in->rd, (rs2 == 0) ? rs1 : rs1 % rs2 ); FC_CONTINUE();
+
+//wval is what gets written to the CSR, rval ends up in rd
+#define FC_CSR( writeExpr ) { \
+        rval = FastCoreReadCSR(ctx, state, image, in->imm, cycle + FC_RETIRED()); \
+        wval = writeExpr; \
+        FastCoreWriteCSR(ctx, state, image, in->imm, wval); \
+        if (in->rd) REGSET( in->rd, rval ); \
+        FC_CONTINUE(); \
+    }
+    FC_OP( FC_CSRRW ) FC_CSR( rs1 );
+    FC_OP( FC_CSRRS ) FC_CSR( rval | rs1 );
+    FC_OP( FC_CSRRC ) FC_CSR( rval & ~rs1 );
+    FC_OP( FC_CSRRWI ) FC_CSR( in->rs1 );
+    FC_OP( FC_CSRRSI ) FC_CSR( rval | in->rs1 );
+    FC_OP( FC_CSRRCI ) FC_CSR( rval & ~(uint32_t)in->rs1 );
+
+    FC_OP( FC_WFI ) {
+        *numRun = icount + FC_RETIRED();
+        CSR( mstatus ) |= 8;    //Enable interrupts
+        CSR( extraflags ) |= 4; //Infor environment we want to go to sleep.
+        SETCSR( pc, FC_PC() + 4 );
+        return 1;
+    }
+    FC_OP( FC_MRET ) {
+        //Table 7.6. MRET then in mstatus/mstatush sets MPV=0, MPP=0, MIE=MPIE, and MPIE=1.
+        uint32_t startmstatus = CSR( mstatus );
+        uint32_t startextraflags = CSR( extraflags );
+        SETCSR( mstatus , (( startmstatus & 0x80) >> 4) | ((startextraflags&3) << 11) | 0x80 );
+        SETCSR( extraflags, (startextraflags & ~3) | ((startmstatus >> 11) & 3) );
+        FC_EXIT( CSR( mepc ), -1 );
+    }
+    FC_OP( FC_ECALL ) FC_TRAP( ( CSR( extraflags ) & 3) ? (11+1) : (8+1) ); // 8 = "Environment call from U-mode"; 11 = "Environment call from M-mode"
+    FC_OP( FC_EBREAK ) FC_TRAP( 3+1 );
+
+//AMOs only work on RAM, wval is what gets stored back
+#define FC_AMO( modify ) { \
+        addy = rs1 - MINIRV32_RAM_IMAGE_OFFSET; \
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) { rval = rs1; FC_TRAP( 7+1 ); } /* Store/AMO access fault */ \
+        rval = MINIRV32_LOAD4( addy ); \
+        wval = rs2; \
+        modify; \
+        MINIRV32_STORE4( addy, wval ); \
+        if (in->rd) REGSET( in->rd, rval ); \
+        FC_INVALIDATE_STORE( addy, 4 ); \
+        FC_CONTINUE(); \
+    }
+    FC_OP( FC_AMOSWAP ) FC_AMO( );
+    FC_OP( FC_AMOADD ) FC_AMO( wval += rval );
+    FC_OP( FC_AMOXOR ) FC_AMO( wval ^= rval );
+    FC_OP( FC_AMOAND ) FC_AMO( wval &= rval );
+    FC_OP( FC_AMOOR ) FC_AMO( wval |= rval );
+    FC_OP( FC_AMOMIN ) FC_AMO( wval = ((int32_t)wval<(int32_t)rval)?wval:rval );
+    FC_OP( FC_AMOMAX ) FC_AMO( wval = ((int32_t)wval>(int32_t)rval)?wval:rval );
+    FC_OP( FC_AMOMINU ) FC_AMO( wval = (wval<rval)?wval:rval );
+    FC_OP( FC_AMOMAXU ) FC_AMO( wval = (wval>rval)?wval:rval );
+    FC_OP( FC_LR ) {
+        addy = rs1 - MINIRV32_RAM_IMAGE_OFFSET;
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) { rval = rs1; FC_TRAP( 7+1 ); }
+        rval = MINIRV32_LOAD4( addy );
+        CSR( extraflags ) = (CSR( extraflags ) & 0x07) | (addy<<3);
+        if (in->rd) REGSET( in->rd, rval );
+        FC_CONTINUE();
+    }
+    FC_OP( FC_SC ) {
+        addy = rs1 - MINIRV32_RAM_IMAGE_OFFSET;
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) { rval = rs1; FC_TRAP( 7+1 ); }
+        rval = ( CSR( extraflags ) >> 3 != ( addy & 0x1fffffff ) );  // Validate that our reservation slot is OK.
+        if (in->rd) REGSET( in->rd, rval );
+        if (!rval) {
+            MINIRV32_STORE4( addy, rs2 );
+            FC_INVALIDATE_STORE( addy, 4 );
+        }
+        FC_CONTINUE();
+    }
+    FC_OP( FC_AMO_ILLEGAL ) {
+        addy = rs1 - MINIRV32_RAM_IMAGE_OFFSET;
+        if( addy >= MINI_RV32_RAM_SIZE-3 ) { rval = rs1; FC_TRAP( 7+1 ); }
+        FC_TRAP( 2+1 );
+    }
+
+    FC_OP( FC_ILLEGAL ) FC_TRAP( 2+1 ); // Fault: Invalid opcode.
+
+    FC_END_DISPATCH()
+
+blockFallthrough:
+    //Ran off the end of the block (or the budget) without a control transfer
+    icount += (int)(in - blockStart);
+    cycle += (uint32_t)(in - blockStart);
+    pc = blockPc + (uint32_t)((in - blockStart) << 2);
+    exitSlot = ((uint32_t)(in - blockStart) == block->len) ? 1 : -1;
+    goto nextBlock;
+
+blockExit:
+    icount += FC_RETIRED();
+    cycle += FC_RETIRED();
+    goto nextBlock;
+
+exitLoop:
+    *numRun = icount;
+handleTrap:
+    // Handle traps and interrupts.
+    if( trap )
+    {
+        if( trap & 0x80000000 ) // If prefixed with 1 in MSB, it's an interrupt, not a trap.
+        {
+            SETCSR( mcause, trap );
+            SETCSR( mtval, 0 );
+            pc += 4; // PC needs to point to where the PC will return to.
+        }
+        else
+        {
+            SETCSR( mcause,  trap - 1 );
+            SETCSR( mtval, (trap > 5 && trap <= 8)? rval : pc );
+        }
+        SETCSR( mepc, pc ); //TRICKY: The kernel advances mepc automatically.
+        //CSR( mstatus ) & 8 = MIE, & 0x80 = MPIE
+        // On an interrupt, the system moves current MIE into MPIE
+        SETCSR( mstatus, (( CSR( mstatus ) & 0x08) << 4) | (( CSR( extraflags ) & 3 ) << 11) );
+        pc = CSR( mtvec );
+
+        // If trapping, always enter machine mode.
+        CSR( extraflags ) |= 3;
+    }
+
+    if( CSR( cyclel ) > cycle ) CSR( cycleh )++;
+    SETCSR( cyclel, cycle );
+    SETCSR( pc, pc );
+    return 0;
+}
+
+#endif
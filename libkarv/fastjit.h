@@ -0,0 +1,502 @@
+/*-------------------------------------------------------------------------------*\
+ | fastjit.h Copyright (c) 2025 StrandedSoftwareDeveloper under the MIT License  |
+ | x86-64 backend for fastcore, responsibilities include:                        |
+ |  - Owning an executable code arena (mmap/VirtualAlloc)                        |
+ |  - Compiling hot fastcore blocks into native code                             |
+ |  - Keeping the most used guest registers of a block in host registers         |
+ |  - Inlining RAM loads/stores, anything else side-exits to the interpreter     |
+ |                                                                               |
+ | Only included by fastcore.h. A compiled block covers the longest prefix of    |
+ | its records the backend understands. When it leaves early (unsupported        |
+ | instruction, MMIO or out of range access, store to a decoded page) it         |
+ | returns how many records it finished and the interpreter picks up from        |
+ | there, so traps and MMIO only ever happen in one place.                       |
+\*-------------------------------------------------------------------------------*/
+
+#ifndef FASTJIT_H
+#define FASTJIT_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define FJ_ARENA_SIZE (32 * 1024 * 1024)
+//Worst case bytes of native code per record (stores with two page checks are the biggest) plus the fixed parts
+#define FJ_MAX_INSN_BYTES 128
+#define FJ_BLOCK_OVERHEAD 256
+//Number of host registers handed out to guest registers inside a block
+#define FJ_NUM_HOST_REGS 4
+
+//Entries run a whole block or a prefix of it. The return value packs the next guest pc in the top 32 bits,
+//the exit kind in bits 16-17 and the number of records finished in the low 16 bits.
+#define FJ_EXIT_SIDE 0    //Stopped before a record, the interpreter has to run it
+#define FJ_EXIT_TAKEN 1   //Left through the jump/branch target, same as chain slot 0
+#define FJ_EXIT_FALL 2    //Left through the fall through, same as chain slot 1
+#define FJ_EXIT_DYNAMIC 3 //JALR, not chained
+
+typedef struct {
+    uint8_t *code;
+    uint32_t size;
+    uint32_t used;
+} FastJit;
+
+enum { FJ_RAX = 0, FJ_RCX, FJ_RDX, FJ_RBX, FJ_RSP, FJ_RBP, FJ_RSI, FJ_RDI, FJ_R8, FJ_R9, FJ_R10, FJ_R11, FJ_R12, FJ_R13, FJ_R14, FJ_R15 };
+
+//x86 condition codes, used as 0x70+cc (jcc rel8), 0x0F 0x80+cc (jcc rel32) and 0x0F 0x90+cc (setcc)
+enum { FJ_CC_B = 0x2, FJ_CC_AE = 0x3, FJ_CC_E = 0x4, FJ_CC_NE = 0x5, FJ_CC_L = 0xC, FJ_CC_GE = 0xD };
+
+static void FastJitInit(FastJit *jit) {
+#ifdef _WIN32
+    jit->code = VirtualAlloc(NULL, FJ_ARENA_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    jit->code = mmap(NULL, FJ_ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED) jit->code = NULL;
+#endif
+    //No executable memory just means everything stays in the interpreter
+    jit->size = jit->code != NULL ? FJ_ARENA_SIZE : 0;
+    jit->used = 0;
+}
+
+static void FastJitFree(FastJit *jit) {
+    if (jit->code != NULL) {
+#ifdef _WIN32
+        VirtualFree(jit->code, 0, MEM_RELEASE);
+#else
+        munmap(jit->code, jit->size);
+#endif
+    }
+    jit->code = NULL;
+    jit->size = 0;
+}
+
+//Only valid once every block pointing into the arena is gone, which is what FastCoreFlush guarantees
+static void FastJitReset(FastJit *jit) {
+    jit->used = 0;
+}
+
+typedef struct {
+    uint8_t *p;
+    int8_t hostOf[32]; //Host register holding each guest register, -1 if it lives in MiniRV32IMAState.regs
+} FJAsm;
+
+static inline void fjByte(FJAsm *a, uint8_t b) { *a->p++ = b; }
+static inline void fjU32(FJAsm *a, uint32_t v) { memcpy(a->p, &v, 4); a->p += 4; }
+static inline void fjU64(FJAsm *a, uint64_t v) { memcpy(a->p, &v, 8); a->p += 8; }
+
+//REX prefix if anything needs one, w selects 64 bit operands
+static void fjRex(FJAsm *a, int w, int reg, int index, int base) {
+    uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+    if (rex != 0x40) fjByte(a, rex);
+}
+
+//Opcodes above 0xff are two byte 0x0F xx ones
+static void fjOpcode(FJAsm *a, uint32_t op) {
+    if (op > 0xff) fjByte(a, 0x0F);
+    fjByte(a, op & 0xff);
+}
+
+//op with a register ModRM operand
+static void fjOpRR(FJAsm *a, int w, uint32_t op, int reg, int rm) {
+    fjRex(a, w, reg, 0, rm);
+    fjOpcode(a, op);
+    fjByte(a, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+//op with a [base + disp8] operand, base can't be rbp/r13 here but rsp/r12 get their SIB byte
+static void fjOpRMDisp8(FJAsm *a, int w, uint32_t op, int reg, int base, int8_t disp) {
+    fjRex(a, w, reg, 0, base);
+    fjOpcode(a, op);
+    fjByte(a, 0x40 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == FJ_RSP) fjByte(a, 0x24);
+    fjByte(a, (uint8_t)disp);
+}
+
+//op with a [base + index*(1<<scale)] operand
+static void fjOpRMIndex(FJAsm *a, int w, uint32_t op, int reg, int base, int index, int scale) {
+    fjRex(a, w, reg, index, base);
+    fjOpcode(a, op);
+    fjByte(a, 0x04 | ((reg & 7) << 3));
+    fjByte(a, (scale << 6) | ((index & 7) << 3) | (base & 7));
+}
+
+static void fjMovImm32(FJAsm *a, int reg, uint32_t imm) {
+    fjRex(a, 0, 0, 0, reg);
+    fjByte(a, 0xB8 + (reg & 7));
+    fjU32(a, imm);
+}
+
+//Leaves the block with rax = (pc << 32) | (kind << 16) | finished
+static void fjExitImm(FJAsm *a, uint8_t *epilogue, uint32_t pc, uint32_t kind, uint32_t finished) {
+    fjByte(a, 0x48);
+    fjByte(a, 0xB8);
+    fjU64(a, ((uint64_t)pc << 32) | (kind << 16) | finished);
+    fjByte(a, 0xE9);
+    fjU32(a, (uint32_t)(epilogue - (a->p + 4)));
+}
+
+//jcc rel32 with the target filled in later, returns where the displacement goes
+static uint8_t *fjJccForward(FJAsm *a, int cc) {
+    fjByte(a, 0x0F);
+    fjByte(a, 0x80 + cc);
+    uint8_t *patch = a->p;
+    fjU32(a, 0);
+    return patch;
+}
+
+static void fjPatch32(uint8_t *patch, uint8_t *target) {
+    uint32_t rel = (uint32_t)(target - (patch + 4));
+    memcpy(patch, &rel, 4);
+}
+
+static void fjPatch8(uint8_t *patch, uint8_t *target) {
+    *patch = (uint8_t)(target - (patch + 1));
+}
+
+//Returns the host register that holds guest register g, loading it into scratch if it isn't cached
+static int fjSrc(FJAsm *a, uint32_t g, int scratch) {
+    if (g == 0) {
+        fjOpRR(a, 0, 0x31, scratch, scratch); //xor
+        return scratch;
+    }
+    if (a->hostOf[g] >= 0) return a->hostOf[g];
+    fjOpRMDisp8(a, 0, 0x8B, scratch, FJ_RBX, g * 4);
+    return scratch;
+}
+
+static void fjLoadGuest(FJAsm *a, uint32_t g, int dst) {
+    int r = fjSrc(a, g, dst);
+    if (r != dst) fjOpRR(a, 0, 0x89, r, dst);
+}
+
+static void fjStoreGuest(FJAsm *a, uint32_t g, int src) {
+    if (g == 0) return;
+    if (a->hostOf[g] >= 0) {
+        fjOpRR(a, 0, 0x89, src, a->hostOf[g]);
+    } else {
+        fjOpRMDisp8(a, 0, 0x89, src, FJ_RBX, g * 4);
+    }
+}
+
+//Guest registers read and written by a record, for picking what goes in host registers
+static void fjCountUses(const FCInsn *in, uint32_t *uses) {
+    switch (in->op) {
+        case FC_NOP: break;
+        case FC_LUI: case FC_AUIPC: case FC_JAL: uses[in->rd]++; break;
+        case FC_JALR: uses[in->rd]++; uses[in->rs1]++; break;
+        case FC_BEQ: case FC_BNE: case FC_BLT: case FC_BGE: case FC_BLTU: case FC_BGEU:
+        case FC_SB: case FC_SH: case FC_SW:
+            uses[in->rs1]++; uses[in->rs2]++; break;
+        case FC_LB: case FC_LH: case FC_LW: case FC_LBU: case FC_LHU:
+        case FC_ADDI: case FC_SLTI: case FC_SLTIU: case FC_XORI: case FC_ORI: case FC_ANDI: case FC_SLLI: case FC_SRLI: case FC_SRAI:
+            uses[in->rd]++; uses[in->rs1]++; break;
+        default: uses[in->rd]++; uses[in->rs1]++; uses[in->rs2]++; break;
+    }
+}
+
+//Emits one record, returns 0 if the backend doesn't handle it (nothing is emitted then) and 2 if it left the block.
+//pc is the guest pc of the record and k its index in the block, sideExits collects jumps to "stop before record k".
+static int fjEmitInsn(FJAsm *a, const FCInsn *in, uint32_t pc, uint32_t k, uint8_t *epilogue, uint8_t **sidePatch, uint32_t *sideIndex, uint32_t *numSide) {
+    switch (in->op) {
+        case FC_NOP:
+            return 1;
+        case FC_LUI:
+        case FC_AUIPC:
+            fjMovImm32(a, FJ_RAX, in->imm);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        case FC_JAL:
+            if (in->rd) {
+                fjMovImm32(a, FJ_RAX, pc + 4);
+                fjStoreGuest(a, in->rd, FJ_RAX);
+            }
+            fjExitImm(a, epilogue, in->imm, FJ_EXIT_TAKEN, k + 1);
+            return 2;
+        case FC_JALR:
+            fjLoadGuest(a, in->rs1, FJ_RCX);
+            fjOpRR(a, 0, 0x81, 0, FJ_RCX); fjU32(a, in->imm);       //add ecx, imm
+            fjOpRR(a, 0, 0x83, 4, FJ_RCX); fjByte(a, 0xFE);         //and ecx, ~1
+            if (in->rd) {
+                fjMovImm32(a, FJ_RAX, pc + 4);
+                fjStoreGuest(a, in->rd, FJ_RAX);
+            }
+            fjMovImm32(a, FJ_RAX, (FJ_EXIT_DYNAMIC << 16) | (k + 1));
+            fjOpRR(a, 1, 0xC1, 4, FJ_RCX); fjByte(a, 32);           //shl rcx, 32
+            fjOpRR(a, 1, 0x09, FJ_RCX, FJ_RAX);                     //or rax, rcx
+            fjByte(a, 0xE9);
+            fjU32(a, (uint32_t)(epilogue - (a->p + 4)));
+            return 2;
+
+        case FC_BEQ: case FC_BNE: case FC_BLT: case FC_BGE: case FC_BLTU: case FC_BGEU: {
+            static const uint8_t cc[] = { FJ_CC_E, FJ_CC_NE, FJ_CC_L, FJ_CC_GE, FJ_CC_B, FJ_CC_AE };
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            int s2 = fjSrc(a, in->rs2, FJ_RCX);
+            fjOpRR(a, 0, 0x39, s2, FJ_RAX); //cmp eax, rs2
+            fjByte(a, 0x70 + cc[in->op - FC_BEQ]);
+            uint8_t *taken = a->p;
+            fjByte(a, 0);
+            fjExitImm(a, epilogue, pc + 4, FJ_EXIT_FALL, k + 1);
+            fjPatch8(taken, a->p);
+            fjExitImm(a, epilogue, in->imm, FJ_EXIT_TAKEN, k + 1);
+            return 2;
+        }
+
+        case FC_LB: case FC_LH: case FC_LW: case FC_LBU: case FC_LHU:
+        case FC_SB: case FC_SH: case FC_SW: {
+            //Same range check as the interpreter, whatever misses RAM is left to it (MMIO, access faults)
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            fjOpRR(a, 0, 0x81, 0, FJ_RAX); fjU32(a, in->imm - MINIRV32_RAM_IMAGE_OFFSET);
+            fjOpRR(a, 0, 0x81, 7, FJ_RAX); fjU32(a, MINI_RV32_RAM_SIZE - 3);
+            sideIndex[*numSide] = k;
+            sidePatch[(*numSide)++] = fjJccForward(a, FJ_CC_AE);
+
+            if (in->op >= FC_SB) {
+                //Stores touching a decoded page have to go through the interpreter so it can drop the page.
+                //Every other one marks its pages in the dirty map, a page marked just before a side exit is
+                //harmless since the interpreter then does the same store.
+                static const uint32_t storeLen[] = { 1, 2, 4 };
+                uint32_t len = storeLen[in->op - FC_SB];
+                fjOpRMDisp8(a, 1, 0x8B, FJ_RDX, FJ_RSP, 8);         //mov rdx, [rsp+8] (fc->pages)
+                fjOpRMDisp8(a, 1, 0x8B, FJ_R9, FJ_RSP, 0);          //mov r9, [rsp] (fc->dirtyPages)
+                for (uint32_t edge = 0; edge < (len > 1 ? 2 : 1); edge++) {
+                    fjOpRR(a, 0, 0x89, FJ_RAX, FJ_R8);              //mov r8d, eax
+                    if (edge) {
+                        fjOpRR(a, 0, 0x83, 0, FJ_R8); fjByte(a, len - 1);
+                    }
+                    fjOpRR(a, 0, 0xC1, 5, FJ_R8); fjByte(a, FC_PAGE_SHIFT);
+                    fjOpRMIndex(a, 1, 0x83, 7, FJ_RDX, FJ_R8, 3); fjByte(a, 0); //cmp qword [rdx+r8*8], 0
+                    sideIndex[*numSide] = k;
+                    sidePatch[(*numSide)++] = fjJccForward(a, FJ_CC_NE);
+                    fjOpRMIndex(a, 0, 0xC6, 0, FJ_R9, FJ_R8, 0); fjByte(a, 0xFF); //mov byte [r9+r8], 0xff
+                }
+                fjLoadGuest(a, in->rs2, FJ_RCX);
+                if (in->op == FC_SB) {
+                    fjOpRMIndex(a, 0, 0x88, FJ_RCX, FJ_R15, FJ_RAX, 0);
+                } else if (in->op == FC_SH) {
+                    fjByte(a, 0x66);
+                    fjOpRMIndex(a, 0, 0x89, FJ_RCX, FJ_R15, FJ_RAX, 0);
+                } else {
+                    fjOpRMIndex(a, 0, 0x89, FJ_RCX, FJ_R15, FJ_RAX, 0);
+                }
+            } else {
+                static const uint32_t loadOp[] = { 0x0FBE, 0x0FBF, 0x8B, 0x0FB6, 0x0FB7 };
+                fjOpRMIndex(a, 0, loadOp[in->op - FC_LB], FJ_RAX, FJ_R15, FJ_RAX, 0);
+                fjStoreGuest(a, in->rd, FJ_RAX);
+            }
+            return 1;
+        }
+
+        case FC_ADDI: case FC_XORI: case FC_ORI: case FC_ANDI: {
+            static const uint8_t ext[] = { 0, 0, 0, 6, 1, 4 }; //From FC_ADDI: add, -, -, xor, or, and
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            fjOpRR(a, 0, 0x81, ext[in->op - FC_ADDI], FJ_RAX); fjU32(a, in->imm);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        }
+        case FC_SLTI: case FC_SLTIU:
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            fjOpRR(a, 0, 0x81, 7, FJ_RAX); fjU32(a, in->imm);
+            fjOpRR(a, 0, 0x0F90 + (in->op == FC_SLTI ? FJ_CC_L : FJ_CC_B), 0, FJ_RAX);
+            fjOpRR(a, 0, 0x0FB6, FJ_RAX, FJ_RAX);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        case FC_SLLI: case FC_SRLI: case FC_SRAI: {
+            static const uint8_t ext[] = { 4, 5, 7 }; //shl, shr, sar
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            fjOpRR(a, 0, 0xC1, ext[in->op - FC_SLLI], FJ_RAX); fjByte(a, in->imm & 0x1f);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        }
+
+        case FC_ADD: case FC_SUB: case FC_XOR: case FC_OR: case FC_AND: case FC_MUL: {
+            uint32_t op = in->op == FC_ADD ? 0x01 : in->op == FC_SUB ? 0x29 : in->op == FC_XOR ? 0x31 : in->op == FC_OR ? 0x09 : 0x21;
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            int s2 = fjSrc(a, in->rs2, FJ_RCX);
+            if (in->op == FC_MUL) {
+                fjOpRR(a, 0, 0x0FAF, FJ_RAX, s2);   //imul eax, rs2
+            } else {
+                fjOpRR(a, 0, op, s2, FJ_RAX);
+            }
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        }
+        case FC_SLT: case FC_SLTU: {
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            int s2 = fjSrc(a, in->rs2, FJ_RCX);
+            fjOpRR(a, 0, 0x39, s2, FJ_RAX);
+            fjOpRR(a, 0, 0x0F90 + (in->op == FC_SLT ? FJ_CC_L : FJ_CC_B), 0, FJ_RAX);
+            fjOpRR(a, 0, 0x0FB6, FJ_RAX, FJ_RAX);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        }
+        case FC_SLL: case FC_SRL: case FC_SRA: {
+            //x86 masks 32 bit shift counts to 5 bits, just like RV32
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            fjLoadGuest(a, in->rs2, FJ_RCX);
+            fjOpRR(a, 0, 0xD3, in->op == FC_SLL ? 4 : in->op == FC_SRL ? 5 : 7, FJ_RAX);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        }
+        case FC_MULH: case FC_MULHU: {
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            int s2 = fjSrc(a, in->rs2, FJ_RCX);
+            fjOpRR(a, 0, 0xF7, in->op == FC_MULH ? 5 : 4, s2); //imul/mul rs2 -> edx:eax
+            fjStoreGuest(a, in->rd, FJ_RDX);
+            return 1;
+        }
+        case FC_MULHSU:
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            fjOpRR(a, 1, 0x63, FJ_RAX, FJ_RAX);   //movsxd rax, eax
+            fjLoadGuest(a, in->rs2, FJ_RCX);      //Zero extends into rcx
+            fjOpRR(a, 1, 0x0FAF, FJ_RAX, FJ_RCX); //imul rax, rcx
+            fjOpRR(a, 1, 0xC1, 5, FJ_RAX); fjByte(a, 32);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        case FC_DIV: case FC_DIVU: case FC_REM: case FC_REMU: {
+            //Division by zero and INT_MIN/-1 don't trap on RV32, they get handled before x86 can fault
+            int isSigned = in->op == FC_DIV || in->op == FC_REM;
+            int isRem = in->op == FC_REM || in->op == FC_REMU;
+            uint8_t *toZero, *toOverflow = NULL, *toEnd[2];
+            fjLoadGuest(a, in->rs1, FJ_RAX);
+            fjLoadGuest(a, in->rs2, FJ_RCX);
+            fjOpRR(a, 0, 0x85, FJ_RCX, FJ_RCX);   //test ecx, ecx
+            fjByte(a, 0x70 + FJ_CC_E); toZero = a->p; fjByte(a, 0);
+            if (isSigned) {
+                uint8_t *toDivide;
+                fjOpRR(a, 0, 0x83, 7, FJ_RCX); fjByte(a, 0xFF);                 //cmp ecx, -1
+                fjByte(a, 0x70 + FJ_CC_NE); toDivide = a->p; fjByte(a, 0);
+                fjOpRR(a, 0, 0x81, 7, FJ_RAX); fjU32(a, 0x80000000);            //cmp eax, INT_MIN
+                fjByte(a, 0x70 + FJ_CC_E); toOverflow = a->p; fjByte(a, 0);
+                fjPatch8(toDivide, a->p);
+                fjByte(a, 0x99);                                                 //cdq
+            } else {
+                fjOpRR(a, 0, 0x31, FJ_RDX, FJ_RDX);
+            }
+            fjOpRR(a, 0, 0xF7, isSigned ? 7 : 6, FJ_RCX);                       //idiv/div ecx
+            if (isRem) fjOpRR(a, 0, 0x89, FJ_RDX, FJ_RAX);
+            fjByte(a, 0xEB); toEnd[0] = a->p; fjByte(a, 0);
+            fjPatch8(toZero, a->p);
+            if (!isRem) fjMovImm32(a, FJ_RAX, 0xffffffff);                       //Quotient is all ones, remainder is rs1
+            fjByte(a, 0xEB); toEnd[1] = a->p; fjByte(a, 0);
+            if (toOverflow != NULL) {
+                fjPatch8(toOverflow, a->p);
+                if (isRem) fjOpRR(a, 0, 0x31, FJ_RAX, FJ_RAX);                  //Quotient is rs1, remainder is 0
+            }
+            fjPatch8(toEnd[0], a->p);
+            fjPatch8(toEnd[1], a->p);
+            fjStoreGuest(a, in->rd, FJ_RAX);
+            return 1;
+        }
+
+        default:
+            //CSRs, system instructions and atomics stay in the interpreter
+            return 0;
+    }
+}
+
+static int FastJitHasRoom(const FastJit *jit, const FCBlock *block) {
+    return jit->code != NULL && jit->size - jit->used >= FJ_BLOCK_OVERHEAD + block->len * FJ_MAX_INSN_BYTES;
+}
+
+//Compiles as much of the block as it can, returns NULL if not even the first record could be compiled.
+//Check FastJitHasRoom first.
+static void *FastJitCompile(FastJit *jit, const FCBlock *block) {
+
+    FJAsm a;
+    a.p = jit->code + jit->used;
+
+    //Give the busiest guest registers host registers, the rest stay in memory
+    static const int hostRegs[FJ_NUM_HOST_REGS] = { FJ_RBP, FJ_R12, FJ_R13, FJ_R14 };
+    uint32_t uses[32] = { 0 };
+    for (uint32_t k = 0; k < block->len; k++) {
+        fjCountUses(&block->insn[k], uses);
+    }
+    uses[0] = 0;
+    uint8_t allocated[FJ_NUM_HOST_REGS];
+    uint32_t numAllocated = 0;
+    memset(a.hostOf, -1, sizeof(a.hostOf));
+    while (numAllocated < FJ_NUM_HOST_REGS) {
+        uint32_t best = 0;
+        for (uint32_t g = 1; g < 32; g++) {
+            if (a.hostOf[g] < 0 && uses[g] > uses[best]) best = g;
+        }
+        if (uses[best] < 2) break;
+        a.hostOf[best] = hostRegs[numAllocated];
+        allocated[numAllocated++] = best;
+    }
+
+    //The shared epilogue goes first so every exit can jump straight back to it:
+    //write the cached guest registers back, drop fc->pages and fc->dirtyPages and restore the callee saved registers
+    uint8_t *epilogue = a.p;
+    for (uint32_t i = 0; i < numAllocated; i++) {
+        fjOpRMDisp8(&a, 0, 0x89, a.hostOf[allocated[i]], FJ_RBX, allocated[i] * 4);
+    }
+    fjOpRR(&a, 1, 0x83, 0, FJ_RSP); fjByte(&a, 16);  //add rsp, 16
+    fjByte(&a, 0x41); fjByte(&a, 0x5F);               //pop r15
+    fjByte(&a, 0x41); fjByte(&a, 0x5E);               //pop r14
+    fjByte(&a, 0x41); fjByte(&a, 0x5D);               //pop r13
+    fjByte(&a, 0x41); fjByte(&a, 0x5C);               //pop r12
+    fjByte(&a, 0x5D);                                 //pop rbp
+    fjByte(&a, 0x5B);                                 //pop rbx
+    fjByte(&a, 0xC3);
+
+    //Entry: rbx = regs, r15 = image, [rsp+8] = fc->pages, [rsp] = fc->dirtyPages
+    uint8_t *entry = a.p;
+    fjByte(&a, 0x53);                                 //push rbx
+    fjByte(&a, 0x55);                                 //push rbp
+    fjByte(&a, 0x41); fjByte(&a, 0x54);               //push r12
+    fjByte(&a, 0x41); fjByte(&a, 0x55);               //push r13
+    fjByte(&a, 0x41); fjByte(&a, 0x56);               //push r14
+    fjByte(&a, 0x41); fjByte(&a, 0x57);               //push r15
+#ifdef _WIN32
+    fjOpRR(&a, 1, 0x89, FJ_RCX, FJ_RBX);
+    fjOpRR(&a, 1, 0x89, FJ_RDX, FJ_R15);
+    fjByte(&a, 0x41); fjByte(&a, 0x50);               //push r8
+    fjByte(&a, 0x41); fjByte(&a, 0x51);               //push r9
+#else
+    fjOpRR(&a, 1, 0x89, FJ_RDI, FJ_RBX);
+    fjOpRR(&a, 1, 0x89, FJ_RSI, FJ_R15);
+    fjByte(&a, 0x52);                                 //push rdx
+    fjByte(&a, 0x51);                                 //push rcx
+#endif
+    for (uint32_t i = 0; i < numAllocated; i++) {
+        fjOpRMDisp8(&a, 0, 0x8B, a.hostOf[allocated[i]], FJ_RBX, allocated[i] * 4);
+    }
+
+    uint8_t *sidePatch[FC_INSNS_PER_PAGE * 3];
+    uint32_t sideIndex[FC_INSNS_PER_PAGE * 3];
+    uint32_t numSide = 0;
+    uint32_t k;
+    int emitted = 1;
+    for (k = 0; k < block->len && emitted == 1; k++) {
+        emitted = fjEmitInsn(&a, &block->insn[k], block->pc + k * 4, k, epilogue, sidePatch, sideIndex, &numSide);
+        if (!emitted) break;
+    }
+    if (k == 0) {
+        return NULL;
+    }
+    if (emitted == 1 && k == block->len) {
+        //Block ran into the end of its page
+        fjExitImm(&a, epilogue, block->pc + k * 4, FJ_EXIT_FALL, k);
+    } else if (!emitted) {
+        //Stopped at something the backend doesn't know, the interpreter carries on from record k
+        fjMovImm32(&a, FJ_RAX, k);
+        fjByte(&a, 0xE9);
+        fjU32(&a, (uint32_t)(epilogue - (a.p + 4)));
+    }
+
+    //Side exits out of the middle of a record, nothing of that record has happened yet
+    for (uint32_t i = 0; i < numSide; i++) {
+        fjPatch32(sidePatch[i], a.p);
+        fjMovImm32(&a, FJ_RAX, sideIndex[i]);
+        fjByte(&a, 0xE9);
+        fjU32(&a, (uint32_t)(epilogue - (a.p + 4)));
+    }
+
+    jit->used = (uint32_t)(a.p - jit->code);
+    jit->used = (jit->used + 15) & ~15u;
+    return entry;
+}
+
+#endif
@@ -0,0 +1,327 @@
+/*-------------------------------------------------------------------------------*\
+ | guestram.h Copyright (c) 2025 StrandedSoftwareDeveloper under the MIT License |
+ | Guest RAM allocation, responsibilities include:                               |
+ |  - Reserving guest RAM so pages are only committed once the guest uses them   |
+ |  - Handing back zeroed RAM without ever writing to it                         |
+ |  - Clearing RAM by dropping its pages rather than writing zeros over them     |
+ |  - Sharing RAM between computers copy-on-write through a memfd image (Linux)  |
+ |  - Making images of files, like the kernel every computer maps (Linux)        |
+ |  - Filling RAM lazily, a chunk at a time as it is first touched (POSIX)       |
+ |                                                                               |
+ | Untouched pages read as zero and cost no memory, so a computer's footprint    |
+ | follows what its guest actually uses instead of the full RAM size.            |
+\*-------------------------------------------------------------------------------*/
+
+#ifndef GUESTRAM_H
+#define GUESTRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#ifndef _WIN32
+#include <signal.h>
+#include <stdlib.h>
+#include <sched.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+#define GUESTRAM_PAGE_SIZE 4096
+//Lazy RAM gets filled this much at a time, bigger chunks mean fewer faults and fewer mappings for the kernel to track
+#define GUESTRAM_LAZY_CHUNK (64 * GUESTRAM_PAGE_SIZE)
+//Computers that can have lazy RAM at the same time, any more just get filled straight away
+#define GUESTRAM_MAX_LAZY 256
+
+//Fills len bytes of ram starting at ofs, on whichever thread first touched them. It runs inside a SIGSEGV handler,
+//so it mustn't allocate, lock or do I/O.
+typedef void (*GuestRamFillFunc)(void *userData, uint8_t *ram, size_t ofs, size_t len);
+
+typedef struct {
+    uint8_t *ram;
+    size_t size;
+    GuestRamFillFunc fill;
+    void *userData;
+    uint8_t *filled; //A byte per chunk
+} GuestRamLazy;
+
+//Returns size bytes of zeroed RAM, or NULL. Free it with GuestRamFree.
+static uint8_t *GuestRamAlloc(size_t size) {
+#ifdef _WIN32
+    //Committed pages are still only backed by physical memory once they're touched
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void *ram = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return ram == MAP_FAILED ? NULL : ram;
+#endif
+}
+
+#ifndef _WIN32
+static GuestRamLazy *guestRamLazy[GUESTRAM_MAX_LAZY];
+static struct sigaction guestRamOldSegv;
+static int guestRamSegvInstalled;
+//Handlers that may still be looking at a guestRamLazy entry, GuestRamEndLazy waits for them before freeing one
+static int guestRamHandlersActive;
+
+static void GuestRamSegv(int sig, siginfo_t *info, void *context) {
+    uint8_t *addr = info->si_addr;
+    //Counted before any entry is loaded, so one taken out after this is never freed while it's in use here
+    __atomic_add_fetch(&guestRamHandlersActive, 1, __ATOMIC_SEQ_CST);
+    for (int i=0; i<GUESTRAM_MAX_LAZY; i++) {
+        GuestRamLazy *lazy = __atomic_load_n(&guestRamLazy[i], __ATOMIC_SEQ_CST);
+        if (lazy == NULL || addr < lazy->ram || addr >= lazy->ram + lazy->size) {
+            continue;
+        }
+        size_t chunk = (addr - lazy->ram) / GUESTRAM_LAZY_CHUNK;
+        if (lazy->filled[chunk]) {
+            break; //A real fault, whatever it is
+        }
+        size_t ofs = chunk * GUESTRAM_LAZY_CHUNK;
+        size_t len = lazy->size - ofs < GUESTRAM_LAZY_CHUNK ? lazy->size - ofs : GUESTRAM_LAZY_CHUNK;
+        mprotect(lazy->ram + ofs, len, PROT_READ | PROT_WRITE);
+        lazy->fill(lazy->userData, lazy->ram, ofs, len);
+        lazy->filled[chunk] = 1;
+        __atomic_sub_fetch(&guestRamHandlersActive, 1, __ATOMIC_SEQ_CST);
+        return;
+    }
+    //Before chaining, the handler chained to might never return here
+    __atomic_sub_fetch(&guestRamHandlersActive, 1, __ATOMIC_SEQ_CST);
+
+    //Not ours, hand it to whoever was there before (a managed runtime turning it into an exception, say)
+    if (guestRamOldSegv.sa_flags & SA_SIGINFO) {
+        guestRamOldSegv.sa_sigaction(sig, info, context);
+    } else if (guestRamOldSegv.sa_handler != SIG_DFL && guestRamOldSegv.sa_handler != SIG_IGN) {
+        guestRamOldSegv.sa_handler(sig);
+    } else {
+        //Returning faults again, this time into the default action
+        signal(sig, SIG_DFL);
+    }
+}
+#endif
+
+//Stops filling ram lazily, for right before it gets mapped over or freed (chunks never filled stay inaccessible)
+static void GuestRamEndLazy(uint8_t *ram) {
+#ifndef _WIN32
+    for (int i=0; i<GUESTRAM_MAX_LAZY; i++) {
+        GuestRamLazy *lazy = guestRamLazy[i];
+        if (lazy != NULL && lazy->ram == ram) {
+            __atomic_store_n(&guestRamLazy[i], NULL, __ATOMIC_SEQ_CST);
+            //A handler on another thread, faulting on some other computer's RAM, may have loaded it just before
+            while (__atomic_load_n(&guestRamHandlersActive, __ATOMIC_SEQ_CST) != 0) {
+                sched_yield();
+            }
+            free(lazy->filled);
+            free(lazy);
+        }
+    }
+#else
+    (void)ram;
+#endif
+}
+
+//Takes all of ram away from the guest and calls fill for each chunk the first time anything touches it, so a
+//restore only costs what the guest goes on to use. ram has to hold zeroes until then. Only host code that
+//touches ram directly gets the chunks filled, system calls given a pointer into an unfilled chunk fail instead.
+//Only one thread may use ram at a time. Returns false if ram can't be filled lazily here, in which case nothing
+//changed and the caller should fill it right away.
+static bool GuestRamBeginLazy(uint8_t *ram, size_t size, GuestRamFillFunc fill, void *userData) {
+#ifndef _WIN32
+    GuestRamLazy *lazy = calloc(1, sizeof(GuestRamLazy));
+    if (lazy == NULL) {
+        return false;
+    }
+    lazy->ram = ram;
+    lazy->size = size;
+    lazy->fill = fill;
+    lazy->userData = userData;
+    lazy->filled = calloc((size + GUESTRAM_LAZY_CHUNK - 1) / GUESTRAM_LAZY_CHUNK, 1);
+    if (lazy->filled == NULL) {
+        free(lazy);
+        return false;
+    }
+
+    if (!__atomic_exchange_n(&guestRamSegvInstalled, 1, __ATOMIC_ACQ_REL)) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = GuestRamSegv;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &guestRamOldSegv);
+    }
+
+    for (int i=0; i<GUESTRAM_MAX_LAZY; i++) {
+        GuestRamLazy *expected = NULL;
+        if (__atomic_compare_exchange_n(&guestRamLazy[i], &expected, lazy, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            if (mprotect(ram, size, PROT_NONE) == 0) {
+                return true;
+            }
+            __atomic_store_n(&guestRamLazy[i], NULL, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    free(lazy->filled);
+    free(lazy);
+    return false;
+#else
+    (void)ram; (void)size; (void)fill; (void)userData;
+    return false;
+#endif
+}
+
+//Zeroes all of ram and gives back the memory behind it, as if it had just come from GuestRamAlloc. This also
+//unmaps any image from GuestRamShare/GuestRamMapImage.
+static void GuestRamClear(uint8_t *ram, size_t size) {
+    GuestRamEndLazy(ram);
+#ifdef _WIN32
+    if (VirtualFree(ram, size, MEM_DECOMMIT) && VirtualAlloc(ram, size, MEM_COMMIT, PAGE_READWRITE) != NULL) {
+        return;
+    }
+#else
+    //Fresh anonymous pages in the same place, dropping would only bring an image's pages back
+    if (mmap(ram, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) != MAP_FAILED) {
+        return;
+    }
+#endif
+    memset(ram, 0, size);
+}
+
+//Maps ram copy-on-write over image, an fd from GuestRamShare. ram reads the same as the image did when it was
+//shared, and only the pages written afterwards take memory of their own.
+static bool GuestRamMapImage(uint8_t *ram, size_t size, int image) {
+    GuestRamEndLazy(ram);
+#ifdef __linux__
+    return mmap(ram, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE | MAP_FIXED, image, 0) != MAP_FAILED;
+#else
+    (void)ram; (void)size; (void)image;
+    return false;
+#endif
+}
+
+//Moves ram's contents into a new image in shared memory and maps ram over it with GuestRamMapImage, so any
+//number of others can map the same pages. Zero pages stay holes. Returns the image's fd (close it with
+//GuestRamCloseImage once no more mappings of it are needed, existing ones keep it alive), or -1 with ram left
+//as it was if the host can't do this.
+static int GuestRamShare(uint8_t *ram, size_t size) {
+#ifdef __linux__
+    int image = (int)syscall(SYS_memfd_create, "karv-ram", 1u); //MFD_CLOEXEC
+    if (image < 0) {
+        return -1;
+    }
+    uint8_t *shared = MAP_FAILED;
+    if (ftruncate(image, size) == 0) {
+        shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, image, 0);
+    }
+    if (shared == MAP_FAILED) {
+        close(image);
+        return -1;
+    }
+    for (size_t ofs = 0; ofs < size; ofs += GUESTRAM_PAGE_SIZE) {
+        const uint64_t *words = (const uint64_t *)(ram + ofs);
+        for (int i=0; i<GUESTRAM_PAGE_SIZE/8; i++) {
+            if (words[i] != 0) {
+                memcpy(shared + ofs, ram + ofs, GUESTRAM_PAGE_SIZE);
+                break;
+            }
+        }
+    }
+    munmap(shared, size);
+    if (!GuestRamMapImage(ram, size, image)) {
+        close(image);
+        return -1;
+    }
+    return image;
+#else
+    (void)ram; (void)size;
+    return -1;
+#endif
+}
+
+//Makes an image holding the file at path (at most maxLen bytes of it, the rest is left out), for mapping over the
+//start of RAM with GuestRamMapImage(ram, *len, image). The file is mapped and copied once, after that it can change or go away
+//without the image noticing. Returns the image's fd and sets *len to the file's size, or -1 if the file can't be
+//read or the host can't do this.
+static int GuestRamLoadImage(const char *path, size_t maxLen, size_t *len) {
+#ifdef __linux__
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    const uint8_t *file = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = (size_t)st.st_size < maxLen ? (size_t)st.st_size : maxLen;
+        file = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (file == MAP_FAILED) {
+        return -1;
+    }
+
+    int image = (int)syscall(SYS_memfd_create, "karv-file", 1u); //MFD_CLOEXEC
+    size_t imageSize = (size + GUESTRAM_PAGE_SIZE - 1) / GUESTRAM_PAGE_SIZE * GUESTRAM_PAGE_SIZE;
+    uint8_t *shared = MAP_FAILED;
+    if (image >= 0 && ftruncate(image, imageSize) == 0) {
+        shared = mmap(NULL, imageSize, PROT_READ | PROT_WRITE, MAP_SHARED, image, 0);
+    }
+    if (shared == MAP_FAILED) {
+        if (image >= 0) {
+            close(image);
+        }
+        munmap((void *)file, size);
+        return -1;
+    }
+    memcpy(shared, file, size);
+    munmap(shared, imageSize);
+    munmap((void *)file, size);
+    *len = size;
+    return image;
+#else
+    (void)path; (void)maxLen; (void)len;
+    return -1;
+#endif
+}
+
+//Another fd for the same image, so two owners can close theirs independently. -1 if that fails.
+static int GuestRamDupImage(int image) {
+#ifdef __linux__
+    return dup(image);
+#else
+    (void)image;
+    return -1;
+#endif
+}
+
+static void GuestRamCloseImage(int image) {
+#ifdef __linux__
+    if (image >= 0) {
+        close(image);
+    }
+#else
+    (void)image;
+#endif
+}
+
+static void GuestRamFree(uint8_t *ram, size_t size) {
+    if (ram == NULL) {
+        return;
+    }
+    GuestRamEndLazy(ram);
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(ram, 0, MEM_RELEASE);
+#else
+    munmap(ram, size);
+#endif
+}
+
+#endif
@@ -3,11 +3,12 @@
  | The main file of libkarv, responsibilities include:                          |
  |  - Running the emulator                                                      |
  |  - Loading and running Linux                                                 |
- |  - Production of the final framebuffer                                       |
+ |  - Production of the final framebuffer, double buffered                      |
+ |  - Stepping computers synchronously, in batches, or on background threads    |
  |                                                                              |
  | To test, run:                                                                |
  | tcc -g -lX11 -DKARV_TEST KARV/libkarv/terminal.c -run KARV/libkarv/libkarv.c |
- | from a folder with `linux.bin` and `Codepage-437.png`                        |
+ | from a folder with `linux.bin`                                               |
 \*------------------------------------------------------------------------------*/
 //#define KARV_TEST //Uncomment this line for LSP in the test harness code
 
@@ -15,94 +16,718 @@
 #include <ctype.h>
 #define CNFG_IMPLEMENTATION
 #include "externalDeps/rawdraw_sf.h"
-#include "externalDeps/os_generic.h"
-#define STBI_NO_SIMD
 #endif
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "terminal.h"
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "externalDeps/stb_image.h"
+#include "workpool.h"
+#include "guestram.h"
+#include "snapshot.h"
+#include "blitter.h"
 
 typedef struct {
     int statusCode;
     int kbBufferLen;
 } stepRetVal;
 
-static uint32_t HandleControlStore( uint32_t addy, uint32_t val );
-static uint32_t HandleControlLoad( uint32_t addy );
-static void HandleOtherCSRWrite( uint8_t * image, uint16_t csrno, uint32_t value );
-static int32_t HandleOtherCSRRead( uint8_t * image, uint16_t csrno );
+typedef struct KARVContext KARVContext;
+
+static uint32_t HandleControlStore( KARVContext *ctx, uint32_t addy, uint32_t val );
+static uint32_t HandleControlLoad( KARVContext *ctx, uint32_t addy );
+static void HandleOtherCSRWrite( KARVContext *ctx, uint8_t * image, uint16_t csrno, uint32_t value );
+static int32_t HandleOtherCSRRead( KARVContext *ctx, uint8_t * image, uint16_t csrno );
+static void MarkDirtyPages( KARVContext *ctx, uint32_t ofs, uint32_t len );
+
+static const uint32_t ram_amt = 64*1024*1024;
+//The guest's linear framebuffer sits right after RAM (0x84000000), where the cores and the JIT treat it just like
+//RAM. The DTB doesn't tell Linux about it, so only programs that map it themselves ever touch it. It holds as many
+//pages of the screen as fit, at least two (two of 1024x1024 at 32 bits per pixel), and the guest flips between them.
+#define FRAMEBUFFER_OFFSET ram_amt
+#define FRAMEBUFFER_SIZE (8*1024*1024)
+
+//The screen's registers:
+// 0x11000000, 0x11000004 and 0x11800000: width, height and SCREEN_FORMAT_*. Reads give the mode the screen is in,
+//   writes only stage a new one.
+// 0x11800008: writing applies the staged mode, reads give 1 if the last one was taken or 0 if it didn't fit.
+// 0x11000008: where the framebuffer's first page is, 0x11800004: bytes per row, 0x1100000C on: the old window onto
+//   the first page
+// 0x1180000C: bytes from one page to the next, 0x11800010: how many pages there are
+// 0x11800014: writing a page shows it from the end of this step on, reads give the page being shown
+// 0x11800018: counts the frames the host has presented. Once it moves after a flip, the flipped to page is on
+//   screen and the one before it is free to draw into again. There's no interrupt controller to raise one with.
+// 0x11800400 on: the palette, 256 RGBA colours (red in the low byte) that SCREEN_FORMAT_INDEXED8 pixels index.
+//A new mode clears the screen and goes back to showing the first page. It can be any size big enough for a
+//character whose pixels fit in what the host created the screen with at 32 bits per pixel, so a smaller format buys
+//a bigger screen.
+#define SCREEN_FORMAT_RGBA8888 0
+#define SCREEN_FORMAT_RGB565 1   //Red in the top bits
+#define SCREEN_FORMAT_INDEXED8 2 //Starts out as a ramp of greys, so text is still drawn in colour FONT437_INK
+#define NUM_SCREEN_FORMATS 3
+#define PALETTE_SIZE 256
 
-uint32_t ram_amt = 64*1024*1024;
+//The blitter's registers, 0x11900000: writing the guest address of a list of BlitCommands (see blitter.h) runs them
+//into the framebuffer, up to a BLIT_END or BLIT_MAX_COMMANDS of them. Reads give how many the last list ran, with
+//BLIT_STATUS_BAD set if it stopped at one that couldn't run. 0x11900004: the framebuffer page blits draw into.
+//The store runs the whole list inside one guest instruction, so each step only has time for BLIT_BYTES_PER_STEP of
+//blitting, about what its own instructions take (a command still runs if any of that is left). A list that runs
+//out stops with BLIT_STATUS_BUSY set, and the same list from the command it stopped at carries on next step.
+#define BLIT_MAX_COMMANDS 65536
+#define BLIT_STATUS_BAD 0x80000000
+#define BLIT_STATUS_BUSY 0x40000000
+#define BLIT_BYTES_PER_STEP (16*1024*1024) //Of filling, what the other commands cost is counted in the same bytes
+#define BLIT_COMMAND_BYTES 256     //Reading and clipping a command, even one that draws nothing
+#define BLIT_EXPAND_PIXEL_BYTES 32 //BLIT_EXPAND goes a pixel at a time, where the others go a row at a time
 
 #define TARGET_STEPS_PER_TICK 65536*5
+//Batched steps look at their deadline this often
+#define DEADLINE_CHECK_STEPS 65536
+//Guest time that passes with every call into the core
+#define STEP_ELAPSED_US 1024
+//How much guest time one step may skip through while the guest sleeps in WFI, about one physics tick
+#define IDLE_US_PER_STEP 20000
+//Boot counts as finished, and gets saved for the next computer with the same kernel, once this many
+//steps in a row ended with the guest idle. Build with -DKARV_NO_BOOT_SNAPSHOT to always boot from scratch.
+#define BOOT_SNAPSHOT_IDLE_STEPS 50
+//Most rectangles karv_get_damage keeps per frame, past this they're merged into one
+#define MAX_DAMAGE_RECTS 32
 
-#define MINI_RV32_RAM_SIZE ram_amt
+#define MINI_RV32_RAM_SIZE (ram_amt + FRAMEBUFFER_SIZE)
 #define MINIRV32_IMPLEMENTATION
 //#define MINIRV32_RAM_IMAGE_OFFSET 0x0000000
-#define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( HandleControlStore( addy, val ) ) return val;
-#define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = HandleControlLoad( addy );
-#define MINIRV32_OTHERCSR_WRITE( csrno, value ) HandleOtherCSRWrite( image, csrno, value );
-#define MINIRV32_OTHERCSR_READ( csrno, value ) value = HandleOtherCSRRead( image, csrno );
+//The hooks all find their computer through ctx, which both cores take as an extra parameter
+#define MINIRV32_HANDLE_MEM_STORE_CONTROL( addy, val ) if( HandleControlStore( ctx, addy, val ) ) return val;
+#define MINIRV32_HANDLE_MEM_LOAD_CONTROL( addy, rval ) rval = HandleControlLoad( ctx, addy );
+#define MINIRV32_OTHERCSR_WRITE( csrno, value ) HandleOtherCSRWrite( ctx, image, csrno, value );
+#define MINIRV32_OTHERCSR_READ( csrno, value ) value = HandleOtherCSRRead( ctx, image, csrno );
+#if !defined(KARV_REFERENCE_CORE) && (defined(__GNUC__) || defined(__clang__))
+//fastcore steps instead, the reference step is only compiled alongside the accessors and hooks the two share
+#define MINIRV32_DECORATE static __attribute__((unused))
+#endif
+#define MINIRV32_STEPPROTO MINIRV32_DECORATE int32_t MiniRV32IMAStep( KARVContext *ctx, struct MiniRV32IMAState * state, uint8_t * image, uint32_t vProcAddress, uint32_t elapsedUs, int count, int *numRun )
+//Stores also mark their pages in ctx->dirtyPages. Both cores range check before storing, so ofs + 3 is always
+//still in RAM.
+#define MINIRV32_CUSTOM_MEMORY_BUS
+#define MINIRV32_STORE4( ofs, val ) do { MarkDirtyPages( ctx, ofs, 4 ); *(uint32_t*)(image + ofs) = val; } while (0)
+#define MINIRV32_STORE2( ofs, val ) do { MarkDirtyPages( ctx, ofs, 2 ); *(uint16_t*)(image + ofs) = val; } while (0)
+#define MINIRV32_STORE1( ofs, val ) do { MarkDirtyPages( ctx, ofs, 1 ); *(uint8_t*)(image + ofs) = val; } while (0)
+#define MINIRV32_LOAD4( ofs ) *(uint32_t*)(image + ofs)
+#define MINIRV32_LOAD2( ofs ) *(uint16_t*)(image + ofs)
+#define MINIRV32_LOAD1( ofs ) *(uint8_t*)(image + ofs)
+#define MINIRV32_LOAD2_SIGNED( ofs ) *(int16_t*)(image + ofs)
+#define MINIRV32_LOAD1_SIGNED( ofs ) *(int8_t*)(image + ofs)
 #include "externalDeps/mini-rv32ima.h"
 
+//Build with -DKARV_REFERENCE_CORE to run the unmodified mini-rv32ima interpreter instead of fastcore,
+//or with -DFASTCORE_NO_THREADED_DISPATCH to keep fastcore but dispatch through a switch
+#ifndef KARV_REFERENCE_CORE
+#define FASTCORE_CONTEXT_PARAM KARVContext *ctx
+#include "fastcore.h"
+#define KARV_CORE_STEP( ctx, state, image, vProcAddress, elapsedUs, count, numRun ) MiniRV32IMAStepCached( &(ctx)->fastCore, ctx, state, image, vProcAddress, elapsedUs, count, numRun )
+#else
+#define KARV_CORE_STEP( ctx, state, image, vProcAddress, elapsedUs, count, numRun ) MiniRV32IMAStep( ctx, state, image, vProcAddress, elapsedUs, count, numRun )
+#endif
+
 #include "externalDeps/default64mbdtc.h"
 
-static struct MiniRV32IMAState *core;
-static uint8_t *ram_image;//[MINI_RV32_RAM_SIZE];
-const char * kernel_command_line = 0;
-static FILE *logFile;
+static const char * kernel_command_line = 0;
 
-static char *keyboardBuffer = NULL;
-static int32_t kbBufferLen = 0;
+//A whole snapshot RAM is still being filled from, a chunk at a time as it's first touched (see mapState)
+typedef struct {
+    const uint8_t *file;
+    size_t fileSize;
+    uint32_t *pageRecord; //Where each page's record is in file, 0 for pages the snapshot leaves zero
+    volatile int damaged; //Set when a page didn't unpack and was left zero
+} KARVLazyState;
+
+//A mode the screen can be in
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; //SCREEN_FORMAT_*
+} KARVScreenMode;
 
-static TermGraphicsState termGraphicsState;
-static bool first = true;
+//Everything one emulated computer owns, any number of these can exist and be stepped from different threads
+struct KARVContext {
+    struct MiniRV32IMAState *core;
+    uint8_t *ram_image;//[MINI_RV32_RAM_SIZE];
+#ifndef KARV_REFERENCE_CORE
+    FastCore fastCore;
+#endif
+    FILE *logFile;
 
-static void DumpState( struct MiniRV32IMAState * core, uint8_t * ram_image );
+    //Only valid during a step, points at the caller's buffer (or asyncKB for karv_step_async)
+    char *keyboardBuffer;
+    int32_t kbBufferLen;
 
-void setup(uint16_t screenWidth, uint16_t screenHeight) {
-    logFile = fopen("rvlog.txt", "w");
+    //The emulator only ever draws into this back buffer, the front buffer gets what changed once a step has finished
+    uint8_t *backBuffer;
+    uint8_t *frontBuffer; //Page aligned, in screen order, only presentFrame writes it (see karv_get_framebuffer)
+    uint64_t frameGeneration; //Counts the frames that changed the front buffer
+    uint8_t *fbShadow; //The guest framebuffer as it was last drawn onto the screen, see drawFramebuffer
+    TermGraphicsState termGraphicsState;
 
-    termGraphicsState.width = screenWidth;
-    termGraphicsState.height = screenHeight;
-    
-    termGraphicsState.charWidth = 9;
-    termGraphicsState.charHeight = 16;
-    
-    termGraphicsState.cursorX = 0;
-    termGraphicsState.cursorY = 0;
-    termGraphicsState.backupCursorX = 0;
-    termGraphicsState.backupCursorY = 0;
+    //The screen's mode (see the registers above), the terminal has its size. The guest's modes have to fit in the
+    //size the host created the screen with.
+    uint16_t hostWidth;
+    uint16_t hostHeight;
+    uint32_t screenFormat;
+    KARVScreenMode stagedMode;
+    bool modeTaken;
+    uint32_t palette[PALETTE_SIZE];
+    bool paletteChanged; //Since presentFrame last copied it to frontPalette
+    KARVScreenMode frontMode; //What the front buffer is in
+    uint32_t frontPalette[PALETTE_SIZE];
+    uint32_t shownPage; //Of the framebuffer, what drawFramebuffer puts on screen
+    uint32_t framesPresented; //By presentFrame, the guest polls it for vsync
+    uint32_t blitStatus;
+    uint32_t blitPage;
+    uint32_t blitBytesLeft; //Of BLIT_BYTES_PER_STEP, this step
+    int numLoops;
+    //What the last frame changed in the front buffer, see karv_get_damage
+    TermRect damage[MAX_DAMAGE_RECTS];
+    int numDamage;
+
+    //karv_step_async, the thread is started on first use
+    WorkThread *asyncThread;
+    char *asyncKB;
+    int32_t asyncKBCapacity;
+    int32_t asyncKBLen;
+    uint32_t asyncTargetSteps;
+    stepRetVal asyncRet;
+
+    //Boot snapshot, see BOOT_SNAPSHOT_IDLE_STEPS
+    uint64_t bootKey;
+    bool bootSnapshotPending; //Booting from scratch, save once it's done
+    int idleSteps;
+
+    uint8_t *dirtyPages; //A byte per page of RAM, with DIRTY_* bits set once the page has been written
+    uint64_t baseId;     //Of the save state DIRTY_SAVE_STATE is relative to, 0 if there's none
+    int ramImage;        //What RAM is mapped copy-on-write over (see karv_clone), -1 if it's private
+    KARVLazyState *lazyState; //The snapshot RAM is still filling from, NULL once it's all there or replaced
+};
+
+//Bits of a dirtyPages byte, stores set all of them and each user clears its own
+#define DIRTY_SAVE_STATE 1 //Written since the save state base, see karv_save_state_delta
+#define DIRTY_RAM_IMAGE 2  //Written since RAM was mapped over ramImage
+#define DIRTY_FRAMEBUFFER 4 //Framebuffer pages written since drawFramebuffer last looked at them
+
+static inline void MarkDirtyPages( KARVContext *ctx, uint32_t ofs, uint32_t len ) {
+    ctx->dirtyPages[ofs / SNAPSHOT_PAGE_SIZE] = 0xff;
+    ctx->dirtyPages[(ofs + len - 1) / SNAPSHOT_PAGE_SIZE] = 0xff;
+}
+
+//For the host writing straight into guest RAM: marks [ofs, ofs + len) dirty the way a store would, however many
+//pages that is, and drops whatever fastcore decoded from it
+static void hostWroteRam( KARVContext *ctx, uint32_t ofs, uint32_t len ) {
+    if (len == 0) {
+        return;
+    }
+    for (uint32_t page = ofs / SNAPSHOT_PAGE_SIZE; page <= (ofs + len - 1) / SNAPSHOT_PAGE_SIZE; page++) {
+        ctx->dirtyPages[page] = 0xff;
+    }
+#ifndef KARV_REFERENCE_CORE
+    for (uint32_t page = ofs >> FC_PAGE_SHIFT; page <= (ofs + len - 1) >> FC_PAGE_SHIFT; page++) {
+        FastCoreInvalidatePage(&ctx->fastCore, page);
+    }
+#endif
+}
+
+//What a snapshot's SNAPSHOT_SECTION_TERMINAL holds, followed by the terminal's text (see terminalTextSize) and then
+//the back buffer. Together with RAM (where the core lives) this is the whole machine, the UART and CLINT keep no
+//state of their own.
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint32_t format; //With width and height, the mode the text and back buffer are for
+    uint16_t cursorX;
+    uint16_t cursorY;
+    uint16_t backupCursorX;
+    uint16_t backupCursorY;
+    uint16_t drawnCursorCol;
+    uint16_t drawnCursorRow;
+    uint16_t scrollTop;
+    uint16_t scrollBottom;
+    int32_t escState;
+    int32_t escNumA;
+    int32_t escNumB;
+    int32_t numLoops;
+    KARVScreenMode stagedMode;
+    uint32_t modeTaken;
+    uint32_t palette[PALETTE_SIZE];
+    uint32_t shownPage;
+    uint32_t framesPresented;
+    uint32_t blitStatus;
+    uint32_t blitPage;
+} KARVTermSnapshot;
+
+typedef enum {
+    STATE_MISSING,  //Nothing was touched
+    STATE_RESTORED,
+    STATE_DAMAGED,  //RAM and the terminal are left half loaded
+    STATE_INVALID,  //There is a snapshot, but it was found to be broken before anything was touched
+} KARVStateResult;
+
+//Save states replace all of RAM, so unlike boot snapshots they fit whatever kernel the computer started with
+#define SAVE_STATE_KEY 0
+#define NUM_RAM_PAGES (MINI_RV32_RAM_SIZE / SNAPSHOT_PAGE_SIZE)
+
+static void DumpState( KARVContext *ctx );
+static void bootMachine(KARVContext *ctx, FILE *logFile);
+void karv_destroy(KARVContext *ctx);
+
+static void freeLazy(KARVLazyState *lazy) {
+    if (lazy == NULL) {
+        return;
+    }
+    SnapshotUnmapFile(lazy->file, lazy->fileSize);
+    free(lazy->pageRecord);
+    free(lazy);
+}
+
+//Only once RAM isn't lazy any more, the SIGSEGV handler may still be using it until then
+static void freeLazyState(KARVContext *ctx) {
+    freeLazy(ctx->lazyState);
+    ctx->lazyState = NULL;
+}
+
+//Zeroes RAM, which also lets go of whatever image it was mapped over or snapshot it was filling from
+static void clearRam(KARVContext *ctx) {
+    GuestRamClear(ctx->ram_image, MINI_RV32_RAM_SIZE);
+    GuestRamCloseImage(ctx->ramImage);
+    ctx->ramImage = -1;
+    freeLazyState(ctx);
+}
+
+static void clearDirty(KARVContext *ctx, uint8_t bit) {
+    for (uint32_t page=0; page<NUM_RAM_PAGES; page++) {
+        ctx->dirtyPages[page] &= ~bit;
+    }
+}
+
+static size_t termPixelsSize(const TermGraphicsState *tgState) {
+    return tgState->width * tgState->height * tgState->bytesPerPixel;
+}
+
+static uint32_t formatBytesPerPixel(uint32_t format) {
+    return format == SCREEN_FORMAT_RGBA8888 ? 4 : format == SCREEN_FORMAT_RGB565 ? 2 : 1;
+}
+
+//A grey as a pixel in format, for SCREEN_FORMAT_INDEXED8 that's the entry of the default palette
+static uint32_t formatGrey(uint32_t format, uint8_t grey) {
+    if (format == SCREEN_FORMAT_RGB565) {
+        return (grey >> 3) << 11 | (grey >> 2) << 5 | grey >> 3;
+    } else if (format == SCREEN_FORMAT_INDEXED8) {
+        return grey;
+    }
+    return 0xff000000 | grey * 0x010101u;
+}
+
+//The most bytes the screen can take, what the front buffer is allocated for
+static size_t screenBudget(KARVContext *ctx) {
+    return (size_t)ctx->hostWidth * ctx->hostHeight * 4;
+}
+
+//Bytes from one framebuffer page to the next, each one starts on a page of RAM of its own
+static uint32_t framebufferPageStride(const TermGraphicsState *tgState) {
+    return (termPixelsSize(tgState) + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE * SNAPSHOT_PAGE_SIZE;
+}
 
-    int n = 0;
-    termGraphicsState.font = stbi_load("Codepage-437.png", &termGraphicsState.fontWidth, &termGraphicsState.fontHeight, &n, 1);
-    if (termGraphicsState.font == NULL) {
-        fprintf(logFile, "Error: failed to load font\n");
+static uint32_t numFramebufferPages(const TermGraphicsState *tgState) {
+    return FRAMEBUFFER_SIZE / framebufferPageStride(tgState);
+}
+
+//Where a framebuffer page is in RAM
+static uint32_t framebufferPage(KARVContext *ctx, uint32_t page) {
+    return FRAMEBUFFER_OFFSET + page * framebufferPageStride(&ctx->termGraphicsState);
+}
+
+static void currentMode(KARVContext *ctx, KARVScreenMode *mode) {
+    mode->width = ctx->termGraphicsState.width;
+    mode->height = ctx->termGraphicsState.height;
+    mode->format = ctx->screenFormat;
+}
+
+//Whether the guest, or a snapshot, may put the screen in mode
+static bool screenModeFits(KARVContext *ctx, const KARVScreenMode *mode) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    return mode->format < NUM_SCREEN_FORMATS && mode->width >= tgState->charWidth &&
+           mode->height >= tgState->charHeight && mode->width <= UINT16_MAX && mode->height <= UINT16_MAX &&
+           (uint64_t)mode->width * mode->height * formatBytesPerPixel(mode->format) <= screenBudget(ctx);
+}
+
+//Puts the screen in mode (which has to fit) with a blank terminal, reallocating the buffers that follow its size.
+//fbShadow is left for the caller to fill. Returns false, with nothing changed, if they couldn't be allocated.
+static bool setScreenMode(KARVContext *ctx, const KARVScreenMode *mode) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    TermGraphicsState next = *tgState;
+    next.width = mode->width;
+    next.height = mode->height;
+    next.bytesPerPixel = formatBytesPerPixel(mode->format);
+    next.ink = formatGrey(mode->format, terminalInkGrey());
+    next.paper = formatGrey(mode->format, 0);
+    next.cursorX = 0;
+    next.cursorY = 0;
+    next.backupCursorX = 0;
+    next.backupCursorY = 0;
+    size_t pixelsSize = termPixelsSize(&next);
+    next.vram = malloc(pixelsSize);
+    uint8_t *shadow = GuestRamAlloc(pixelsSize);
+    if (next.vram == NULL || shadow == NULL || !initTerminal(&next)) {
+        free(next.vram);
+        GuestRamFree(shadow, pixelsSize);
+        return false;
+    }
+    free(ctx->backBuffer);
+    GuestRamFree(ctx->fbShadow, termPixelsSize(tgState));
+    freeTerminal(tgState);
+    *tgState = next;
+    ctx->backBuffer = next.vram;
+    ctx->fbShadow = shadow;
+    ctx->screenFormat = mode->format;
+    ctx->shownPage = 0;
+    ctx->blitPage = 0;
+    return true;
+}
+
+//Puts the mode term was saved in back, unless the screen is in it already
+static bool restoreScreenMode(KARVContext *ctx, const KARVTermSnapshot *term) {
+    KARVScreenMode mode = { term->width, term->height, term->format };
+    KARVScreenMode current;
+    currentMode(ctx, &current);
+    return memcmp(&mode, &current, sizeof(mode)) == 0 || setScreenMode(ctx, &mode);
+}
+
+//How many bytes of text and pixels follow term in a snapshot, 0 if this screen can't be put in its mode or term
+//doesn't fit that mode
+static size_t termSnapshotSize(KARVContext *ctx, const KARVTermSnapshot *term) {
+    KARVScreenMode mode = { term->width, term->height, term->format };
+    if (!screenModeFits(ctx, &mode)) {
+        return 0;
+    }
+    TermGraphicsState sized = ctx->termGraphicsState;
+    sized.width = mode.width;
+    sized.height = mode.height;
+    sized.bytesPerPixel = formatBytesPerPixel(mode.format);
+    sized.cols = sized.width / sized.charWidth;
+    sized.rows = sized.height / sized.charHeight;
+    if (term->shownPage >= numFramebufferPages(&sized) || term->blitPage >= numFramebufferPages(&sized) ||
+        term->scrollTop > term->scrollBottom || term->scrollBottom >= sized.rows) {
+        return 0;
+    }
+    return terminalTextSize(&sized) + termPixelsSize(&sized);
+}
+
+//Whether a saved row map, which starts the text after a KARVTermSnapshot and may not be aligned, puts each of the
+//rows of the screen on exactly one row of the cells
+static bool rowMapValid(const uint8_t *rowMap, uint16_t rows) {
+    uint8_t *seen = calloc(rows, 1);
+    bool valid = seen != NULL;
+    for (int i=0; valid && i<rows; i++) {
+        uint16_t row;
+        memcpy(&row, rowMap + i * sizeof(row), sizeof(row));
+        valid = row < rows && !seen[row];
+        if (valid) {
+            seen[row] = 1;
+        }
+    }
+    free(seen);
+    return valid;
+}
+
+static void viewTerm(KARVContext *ctx, KARVTermSnapshot *term) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    term->width = tgState->width;
+    term->height = tgState->height;
+    term->format = ctx->screenFormat;
+    term->cursorX = tgState->cursorX;
+    term->cursorY = tgState->cursorY;
+    term->backupCursorX = tgState->backupCursorX;
+    term->backupCursorY = tgState->backupCursorY;
+    term->drawnCursorCol = tgState->drawnCursorCol;
+    term->drawnCursorRow = tgState->drawnCursorRow;
+    term->scrollTop = tgState->scrollTop;
+    term->scrollBottom = tgState->scrollBottom;
+    term->escState = tgState->escState;
+    term->escNumA = tgState->escNumA;
+    term->escNumB = tgState->escNumB;
+    term->numLoops = ctx->numLoops;
+    term->stagedMode = ctx->stagedMode;
+    term->modeTaken = ctx->modeTaken;
+    memcpy(term->palette, ctx->palette, sizeof(term->palette));
+    term->shownPage = ctx->shownPage;
+    term->framesPresented = ctx->framesPresented;
+    term->blitStatus = ctx->blitStatus;
+    term->blitPage = ctx->blitPage;
+}
+
+//Everything but the mode (see restoreScreenMode) and the text and pixels, which go straight into the terminal's
+//own buffers
+static void restoreTerm(KARVContext *ctx, const KARVTermSnapshot *term) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    tgState->cursorX = term->cursorX;
+    tgState->cursorY = term->cursorY;
+    tgState->backupCursorX = term->backupCursorX;
+    tgState->backupCursorY = term->backupCursorY;
+    tgState->drawnCursorCol = term->drawnCursorCol;
+    tgState->drawnCursorRow = term->drawnCursorRow;
+    tgState->scrollTop = term->scrollTop;
+    tgState->scrollBottom = term->scrollBottom;
+    tgState->escState = term->escState;
+    tgState->escNumA = term->escNumA;
+    tgState->escNumB = term->escNumB;
+    if (tgState->scrollTop > tgState->scrollBottom || tgState->scrollBottom >= tgState->rows) {
+        resetScrollRegion(tgState); //Like the pages below, the loaders already turned these away
+    }
+    ctx->numLoops = term->numLoops;
+    ctx->stagedMode = term->stagedMode;
+    ctx->modeTaken = term->modeTaken != 0;
+    memcpy(ctx->palette, term->palette, sizeof(ctx->palette));
+    ctx->paletteChanged = true;
+    //The loaders already turned away pages past the end, this is just so nothing can ever point outside RAM
+    uint32_t numPages = numFramebufferPages(tgState);
+    ctx->shownPage = term->shownPage < numPages ? term->shownPage : 0;
+    ctx->framesPresented = term->framesPresented;
+    ctx->blitStatus = term->blitStatus;
+    ctx->blitPage = term->blitPage < numPages ? term->blitPage : 0;
+    //Cells saved dirty still need drawing, and the cursor may have been saved drawn
+    tgState->dirty = true;
+    tgState->drawnCursorShown = true;
+    damageRect(tgState, 0, 0, tgState->width, tgState->height);
+}
+
+static void resetTerminal(KARVContext *ctx) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    tgState->cursorX = 0;
+    tgState->cursorY = 0;
+    tgState->backupCursorX = 0;
+    tgState->backupCursorY = 0;
+    tgState->escState = NORMAL;
+    tgState->escNumA = 0;
+    tgState->escNumB = 0;
+    tgState->drawnCursorCol = 0;
+    tgState->drawnCursorRow = 0;
+    ctx->numLoops = 0;
+    resetScrollRegion(tgState);
+    clearScreen(tgState);
+}
+
+//Back to the mode the host created the screen in, with the default palette and a blank terminal. The buffers
+//of a guest's mode stay if that one can't be allocated.
+static void resetScreen(KARVContext *ctx) {
+    KARVScreenMode mode = { ctx->hostWidth, ctx->hostHeight, SCREEN_FORMAT_RGBA8888 };
+    for (int i=0; i<PALETTE_SIZE; i++) {
+        ctx->palette[i] = formatGrey(SCREEN_FORMAT_RGBA8888, i);
+    }
+    ctx->paletteChanged = true;
+    ctx->stagedMode = mode;
+    ctx->modeTaken = true;
+    setScreenMode(ctx, &mode);
+    resetTerminal(ctx);
+}
+
+//Everything a computer needs except what's in its RAM, which comes back zeroed
+static KARVContext *newContext(uint16_t screenWidth, uint16_t screenHeight, const char *logPath) {
+    KARVContext *ctx = calloc(1, sizeof(KARVContext));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->ramImage = -1;
+    ctx->logFile = logPath != NULL ? fopen(logPath, "w") : NULL;
+    FILE *logFile = ctx->logFile != NULL ? ctx->logFile : stderr;
+
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    tgState->charWidth = 9;
+    tgState->charHeight = 16;
+    ctx->hostWidth = screenWidth;
+    ctx->hostHeight = screenHeight;
+
+    if (screenBudget(ctx) * 2 > FRAMEBUFFER_SIZE || screenWidth < tgState->charWidth ||
+        screenHeight < tgState->charHeight) {
+        fprintf(logFile, "Error: a %ux%u screen doesn't fit in the guest's framebuffer\n", screenWidth, screenHeight);
+        fflush(logFile);
+        karv_destroy(ctx);
+        return NULL;
+    }
+    //The front buffer stays put whatever mode the guest picks, only the pages the mode uses get committed
+    ctx->frontBuffer = GuestRamAlloc(screenBudget(ctx));
+    if (ctx->frontBuffer != NULL) {
+        resetScreen(ctx);
+    }
+    if (ctx->frontBuffer == NULL || ctx->backBuffer == NULL) {
+        fprintf(logFile, "Error: failed to allocate the screen\n");
+        fflush(logFile);
+        karv_destroy(ctx);
+        return NULL;
     }
+    currentMode(ctx, &ctx->frontMode);
+    memcpy(ctx->frontPalette, ctx->palette, sizeof(ctx->palette));
+    ctx->paletteChanged = false;
+    copyScreen(tgState, ctx->frontBuffer);
 
-    ram_image = malloc(MINI_RV32_RAM_SIZE);
-    memset(ram_image, 0, MINI_RV32_RAM_SIZE);
+    //Comes back zeroed, and only the pages the kernel, DTB and guest touch ever get committed
+    ctx->ram_image = GuestRamAlloc(MINI_RV32_RAM_SIZE);
+    ctx->dirtyPages = calloc(NUM_RAM_PAGES, 1);
+    if (ctx->ram_image == NULL || ctx->dirtyPages == NULL) {
+        fprintf(logFile, "Error: failed to allocate guest RAM\n");
+        fflush(logFile);
+        karv_destroy(ctx);
+        return NULL;
+    }
 
-    FILE *rom = fopen("linux.bin", "rb");
-    if (rom == NULL) {
+#ifndef KARV_REFERENCE_CORE
+    FastCoreInit(&ctx->fastCore, MINI_RV32_RAM_SIZE, ctx->dirtyPages);
+#endif
+    return ctx;
+}
+
+//logPath can be NULL for no log, give every computer its own file
+KARVContext *karv_create(uint16_t screenWidth, uint16_t screenHeight, const char *logPath) {
+    KARVContext *ctx = newContext(screenWidth, screenHeight, logPath);
+    if (ctx == NULL) {
+        return NULL;
+    }
+    FILE *logFile = ctx->logFile != NULL ? ctx->logFile : stderr;
+
+    bootMachine(ctx, logFile);
+
+#ifdef KARV_RAM_CHECKSUM
+	//Reads every page of RAM and so commits all of it, only for debugging
+	uint8_t checksum = 0;
+	for (int i=0; i<ram_amt; i++) {
+		checksum += ctx->ram_image[i];
+	}
+	fprintf(logFile, "Checksum: 0x%x\n", checksum);
+#endif
+
+    fprintf(logFile, "Finished setup\n");
+    fflush(logFile);
+    return ctx;
+}
+
+//Makes ram (zeroed, from GuestRamAlloc) a copy of src's RAM. Where the host allows it, src moves into an image the
+//first time this happens and ram gets mapped over it, after that only the pages src wrote since the image was made
+//need copying. Elsewhere the pages with a bit of pageMask in src->dirtyPages get copied, or every non-zero one for
+//a pageMask of 0. Copied pages get marked in dirtyPages if it isn't NULL. Returns true if ram maps src->ramImage.
+static bool copyRam(KARVContext *src, uint8_t *ram, uint8_t *dirtyPages, uint8_t pageMask) {
+    if (src->ramImage < 0) {
+        src->ramImage = GuestRamShare(src->ram_image, MINI_RV32_RAM_SIZE);
+        clearDirty(src, DIRTY_RAM_IMAGE);
+        if (src->ramImage >= 0) {
+            freeLazyState(src); //Sharing read (and so filled) all of it
+        }
+    }
+    //The core changes without going through a store, so it always gets copied
+    MarkDirtyPages(src, (uint32_t)((uint8_t *)src->core - src->ram_image), sizeof(struct MiniRV32IMAState));
+    bool mapped = src->ramImage >= 0 && GuestRamMapImage(ram, MINI_RV32_RAM_SIZE, src->ramImage);
+    for (uint32_t page=0; page<NUM_RAM_PAGES; page++) {
+        uint8_t *data = src->ram_image + (size_t)page * SNAPSHOT_PAGE_SIZE;
+        bool copy = mapped ? src->dirtyPages[page] & DIRTY_RAM_IMAGE :
+                    pageMask != 0 ? src->dirtyPages[page] & pageMask : !SnapshotIsZeroPage(data);
+        if (copy) {
+            memcpy(ram + (size_t)page * SNAPSHOT_PAGE_SIZE, data, SNAPSHOT_PAGE_SIZE);
+            if (dirtyPages != NULL) {
+                dirtyPages[page] = 0xff;
+            }
+        }
+    }
+    return mapped;
+}
+
+//Makes a new computer that's an exact copy of src, so any number of them can start off one that's already booted.
+//Where the host allows it (Linux) they all end up with their RAM mapped copy-on-write over one shared image, and a
+//clone only costs memory for the pages it, or src, writes afterwards. Elsewhere RAM is copied.
+//logPath works like karv_create's. Only call while nothing is stepping src.
+KARVContext *karv_clone(KARVContext *src, const char *logPath) {
+    TermGraphicsState *srcTerm = &src->termGraphicsState;
+    KARVContext *ctx = newContext(src->hostWidth, src->hostHeight, logPath);
+    KARVTermSnapshot term;
+    viewTerm(src, &term);
+    if (ctx == NULL || !restoreScreenMode(ctx, &term)) {
+        karv_destroy(ctx);
+        return NULL;
+    }
+
+    bool mapped = copyRam(src, ctx->ram_image, ctx->dirtyPages, 0);
+    if (mapped) {
+        ctx->ramImage = GuestRamDupImage(src->ramImage);
+    }
+    ctx->core = (struct MiniRV32IMAState *)(ctx->ram_image + ((uint8_t *)src->core - src->ram_image));
+
+    restoreTerm(ctx, &term);
+    memcpy(ctx->termGraphicsState.rowMap, srcTerm->rowMap, terminalTextSize(srcTerm));
+    memcpy(ctx->backBuffer, src->backBuffer, termPixelsSize(srcTerm));
+    memcpy(ctx->fbShadow, src->fbShadow, termPixelsSize(srcTerm));
+
+    //A clone of a computer that's still booting can save the boot snapshot just as well
+    ctx->bootKey = src->bootKey;
+    ctx->bootSnapshotPending = src->bootSnapshotPending;
+    ctx->idleSteps = src->idleSteps;
+
+    FILE *logFile = ctx->logFile != NULL ? ctx->logFile : stderr;
+    fprintf(logFile, mapped ? "Cloned, sharing RAM\n" : "Cloned, RAM copied\n");
+    fflush(logFile);
+    return ctx;
+}
+
+//linux.bin as every computer in the process maps it, read once and then shared copy-on-write (see loadKernel)
+static struct {
+    int lock;
+    int image;   //-1 until a computer has loaded it, or if the host can't share it
+    size_t len;
+    struct stat st; //Of the file the image was made from
+} kernelImage = { .image = -1 };
+
+//Maps linux.bin over the start of zeroed RAM, so the kernel costs no I/O after the first computer and no memory
+//until a guest writes over it. Returns the kernel's size, or 0 if it couldn't be shared (ctx is left untouched).
+static size_t mapKernel(KARVContext *ctx) {
+    struct stat st;
+    if (stat("linux.bin", &st) != 0) {
+        return 0;
+    }
+    while (__atomic_exchange_n(&kernelImage.lock, 1, __ATOMIC_ACQUIRE)) {
+    }
+    //Whoever replaced linux.bin wants the new one from now on, computers already mapping the old image keep it
+    if (kernelImage.image >= 0 && (st.st_size != kernelImage.st.st_size || st.st_mtime != kernelImage.st.st_mtime ||
+                                   st.st_ino != kernelImage.st.st_ino || st.st_dev != kernelImage.st.st_dev)) {
+        GuestRamCloseImage(kernelImage.image);
+        kernelImage.image = -1;
+    }
+    if (kernelImage.image < 0 && st.st_size <= ram_amt) {
+        kernelImage.image = GuestRamLoadImage("linux.bin", ram_amt, &kernelImage.len);
+        kernelImage.st = st;
+    }
+    size_t kernelLen = 0;
+    if (kernelImage.image >= 0 && GuestRamMapImage(ctx->ram_image, kernelImage.len, kernelImage.image)) {
+        kernelLen = kernelImage.len;
+    }
+    __atomic_store_n(&kernelImage.lock, 0, __ATOMIC_RELEASE);
+    return kernelLen;
+}
+
+//Puts linux.bin and the DTB into zeroed RAM and sets the core up like a fresh power on.
+//Returns how many bytes of kernel were loaded.
+static size_t loadMachine(KARVContext *ctx, FILE *logFile) {
+    //Read it into RAM of our own where it can't be shared
+    size_t kernelLen = mapKernel(ctx);
+    FILE *rom = kernelLen == 0 ? fopen("linux.bin", "rb") : NULL;
+    if (kernelLen == 0 && rom == NULL) {
         fprintf(logFile, "Error: rom not found\n");
-    } else {
+    } else if (rom != NULL) {
         fseek(rom, 0, SEEK_END);
         size_t len = ftell(rom);
         printf("len:%lu\n", len);
         fseek(rom, 0, SEEK_SET);
         
-        if (len <= MINI_RV32_RAM_SIZE) {
-            fread(ram_image, sizeof(uint8_t), len, rom);
+        if (len <= ram_amt) {
+            kernelLen = fread(ctx->ram_image, sizeof(uint8_t), len, rom);
         } else {
             fprintf(logFile, "Error: rom too big\n");
         }
@@ -114,80 +739,1014 @@ void setup(uint16_t screenWidth, uint16_t screenHeight) {
 
     // Load a default dtb.
     dtb_ptr = ram_amt - sizeof(default64mbdtb) - sizeof( struct MiniRV32IMAState );
-    memcpy( ram_image + dtb_ptr, default64mbdtb, sizeof( default64mbdtb ) );
+    memcpy( ctx->ram_image + dtb_ptr, default64mbdtb, sizeof( default64mbdtb ) );
     if (kernel_command_line) {
-        strncpy( (char*)( ram_image + dtb_ptr + 0xc0 ), kernel_command_line, 54 );
+        strncpy( (char*)( ctx->ram_image + dtb_ptr + 0xc0 ), kernel_command_line, 54 );
     }
 
     // The core lives at the end of RAM.
-	core = (struct MiniRV32IMAState *)(ram_image + ram_amt - sizeof( struct MiniRV32IMAState ));
-	core->pc = MINIRV32_RAM_IMAGE_OFFSET;
-	core->regs[10] = 0x00; //hart ID
-	core->regs[11] = dtb_ptr?(dtb_ptr+MINIRV32_RAM_IMAGE_OFFSET):0; //dtb_pa (Must be valid pointer) (Should be pointer to dtb)
-	core->extraflags |= 3; // Machine-mode.
+	ctx->core = (struct MiniRV32IMAState *)(ctx->ram_image + ram_amt - sizeof( struct MiniRV32IMAState ));
+	ctx->core->pc = MINIRV32_RAM_IMAGE_OFFSET;
+	ctx->core->regs[10] = 0x00; //hart ID
+	ctx->core->regs[11] = dtb_ptr?(dtb_ptr+MINIRV32_RAM_IMAGE_OFFSET):0; //dtb_pa (Must be valid pointer) (Should be pointer to dtb)
+	ctx->core->extraflags |= 3; // Machine-mode.
 
 	if (1) {
 		// Update system ram size in DTB (but if and only if we're using the default DTB)
 		// Warning - this will need to be updated if the skeleton DTB is ever modified.
-		uint32_t * dtb = (uint32_t*)(ram_image + dtb_ptr);
+		uint32_t * dtb = (uint32_t*)(ctx->ram_image + dtb_ptr);
 		if( dtb[0x13c/4] == 0x00c0ff03 )
 		{
 			uint32_t validram = dtb_ptr;
 			dtb[0x13c/4] = (validram>>24) | ((( validram >> 16 ) & 0xff) << 8 ) | (((validram>>8) & 0xff ) << 16 ) | ( ( validram & 0xff) << 24 );
 		}
 	}
+    return kernelLen;
+}
 
-	uint8_t checksum = 0;
-	for (int i=0; i<ram_amt; i++) {
-		checksum += ram_image[i];
-	}
-	fprintf(logFile, "Checksum: 0x%x\n", checksum);
+#ifndef KARV_NO_BOOT_SNAPSHOT
+//Everything that decides how a boot goes: the kernel, the DTB (which has the command line in it), plus the
+//RAM and screen size a snapshot has to fit. Call right after loadMachine.
+static uint64_t bootSnapshotKey(KARVContext *ctx, size_t kernelLen) {
+    uint32_t dtb_ptr = ram_amt - sizeof(default64mbdtb) - sizeof( struct MiniRV32IMAState );
+    uint32_t sizes[3] = { MINI_RV32_RAM_SIZE, ctx->termGraphicsState.width, ctx->termGraphicsState.height };
+    const char *cmdline = kernel_command_line != NULL ? kernel_command_line : "";
 
-    fprintf(logFile, "Finished setup\n");
-    fflush(logFile);
+    uint64_t key = SnapshotHash(SNAPSHOT_HASH_SEED, ctx->ram_image, kernelLen);
+    key = SnapshotHash(key, ctx->ram_image + dtb_ptr, sizeof(default64mbdtb));
+    key = SnapshotHash(key, cmdline, strlen(cmdline));
+    return SnapshotHash(key, sizes, sizeof(sizes));
 }
 
-stepRetVal step(uint8_t *vram, char *kbBuffer, int32_t len, uint32_t targetSteps) {
-    static int numLoops = 0;
-    //fprintf(logFile, "\nLoops:%d\n", numLoops);
-    //fflush(logFile);
+//Snapshots sit next to linux.bin, one per key
+static void bootSnapshotPath(KARVContext *ctx, char *path, size_t size) {
+    snprintf(path, size, "karv-boot-%016llx.snap", (unsigned long long)ctx->bootKey);
+}
+#endif
 
-    keyboardBuffer = kbBuffer;
-    kbBufferLen = len;
+//Reads just the header of a snapshot, false if path doesn't hold one for key
+static bool peekState(const char *path, uint64_t key, SnapshotHeader *header) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = SnapshotReadHeader(f, key, MINI_RV32_RAM_SIZE, header);
+    fclose(f);
+    return ok;
+}
 
-    termGraphicsState.vram = vram;
-    if (first) {
-        clearScreen(&termGraphicsState);
-        first = false;
+//Unpacks the snapshot's pages in [ofs, ofs + len) into ram. Runs inside the SIGSEGV handler, see GuestRamFillFunc.
+static void fillLazyRam(void *userData, uint8_t *ram, size_t ofs, size_t len) {
+    KARVLazyState *lazy = userData;
+    for (size_t page = ofs / SNAPSHOT_PAGE_SIZE; page < (ofs + len) / SNAPSHOT_PAGE_SIZE; page++) {
+        uint32_t record = lazy->pageRecord[page];
+        uint8_t *data = ram + page * SNAPSHOT_PAGE_SIZE;
+        if (record != 0 && !SnapshotLoadPage(lazy->file + record, data)) {
+            memset(data, 0, SNAPSHOT_PAGE_SIZE);
+            lazy->damaged = 1;
+        }
     }
+}
 
-    numLoops += 1;
+//readState for a whole snapshot, except RAM is filled straight from the mapped file as it's first touched, so
+//restoring costs next to nothing up front and pages the guest never goes back to are never unpacked. Everything
+//but the page data is checked before anything is touched, so a broken file gives STATE_INVALID with the computer as
+//it was. STATE_MISSING if the file can't be mapped here.
+static KARVStateResult mapState(KARVContext *ctx, const char *path, uint64_t key) {
+    KARVLazyState *lazy = calloc(1, sizeof(KARVLazyState));
+    if (lazy == NULL) {
+        return STATE_MISSING;
+    }
+    lazy->file = SnapshotMapFile(path, &lazy->fileSize);
+    lazy->pageRecord = calloc(NUM_RAM_PAGES, sizeof(uint32_t));
+    SnapshotHeader header;
+    if (lazy->file == NULL || lazy->pageRecord == NULL || lazy->fileSize < sizeof(header)) {
+        freeLazy(lazy);
+        return STATE_MISSING;
+    }
+    memcpy(&header, lazy->file, sizeof(header));
+    bool valid = SnapshotCheckHeader(&header, key, MINI_RV32_RAM_SIZE) && header.baseId == 0;
+    KARVStateResult result = valid ? STATE_INVALID : STATE_MISSING;
+
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    KARVTermSnapshot term;
+    const uint8_t *termData = NULL; //Text then pixels
+    bool gotRAM = false;
+    uint64_t ofs = sizeof(header);
+    SnapshotSection section;
+    while (result == STATE_INVALID && lazy->fileSize - ofs >= sizeof(section)) {
+        memcpy(&section, lazy->file + ofs, sizeof(section));
+        ofs += sizeof(section);
+        if (section.size > lazy->fileSize - ofs) {
+            break;
+        }
+        if (section.tag == SNAPSHOT_SECTION_END) {
+            if (gotRAM && termData != NULL) {
+                result = STATE_RESTORED;
+            }
+            break;
+        } else if (section.tag == SNAPSHOT_SECTION_RAM) {
+            if (!SnapshotIndexRAM(lazy->file, ofs, section.size, MINI_RV32_RAM_SIZE, lazy->pageRecord)) {
+                break;
+            }
+            gotRAM = true;
+        } else if (section.tag == SNAPSHOT_SECTION_TERMINAL) {
+            if (section.size < sizeof(term)) {
+                break;
+            }
+            memcpy(&term, lazy->file + ofs, sizeof(term));
+            size_t termSize = termSnapshotSize(ctx, &term);
+            if (termSize == 0 || section.size != sizeof(term) + termSize ||
+                !rowMapValid(lazy->file + ofs + sizeof(term), term.height / tgState->charHeight)) {
+                break;
+            }
+            termData = lazy->file + ofs + sizeof(term);
+        } else {
+            break;
+        }
+        ofs += section.size;
+    }
+    if (result == STATE_RESTORED && !restoreScreenMode(ctx, &term)) {
+        result = STATE_INVALID; //Nothing changes when the mode can't be set either
+    }
+    if (result != STATE_RESTORED) {
+        freeLazy(lazy);
+        return result;
+    }
+
+    clearRam(ctx);
+    size_t textSize = terminalTextSize(tgState);
+    memcpy(tgState->rowMap, termData, textSize);
+    memcpy(ctx->backBuffer, termData + textSize, termPixelsSize(tgState));
+    restoreTerm(ctx, &term);
+
+    ctx->lazyState = lazy;
+    if (!GuestRamBeginLazy(ctx->ram_image, MINI_RV32_RAM_SIZE, fillLazyRam, lazy)) {
+        //Too many lazy computers already, fill it all now
+        fillLazyRam(lazy, ctx->ram_image, 0, MINI_RV32_RAM_SIZE);
+        result = lazy->damaged ? STATE_DAMAGED : STATE_RESTORED;
+        freeLazyState(ctx);
+    }
+    return result;
+}
+
+//readState streams RAM straight in, where it can't be taken back, so this looks ahead at the terminal section (the
+//part that can turn out not to fit this computer) before it starts. f is left where it was.
+static bool streamedTermFits(KARVContext *ctx, FILE *f) {
+    long start = ftell(f);
+    bool fits = false;
+    SnapshotSection section;
+    while (start >= 0 && SnapshotReadSection(f, &section) && section.tag != SNAPSHOT_SECTION_END) {
+        if (section.tag == SNAPSHOT_SECTION_TERMINAL) {
+            KARVTermSnapshot term;
+            if (section.size >= sizeof(term) && fread(&term, sizeof(term), 1, f) == 1) {
+                size_t termSize = termSnapshotSize(ctx, &term);
+                uint16_t rows = term.height / ctx->termGraphicsState.charHeight;
+                uint8_t *rowMap = malloc(rows * sizeof(uint16_t));
+                fits = termSize != 0 && section.size == sizeof(term) + termSize && rowMap != NULL &&
+                       fread(rowMap, rows * sizeof(uint16_t), 1, f) == 1 && rowMapValid(rowMap, rows);
+                free(rowMap);
+            }
+            break;
+        }
+        if (section.size > LONG_MAX || fseek(f, (long)section.size, SEEK_CUR) != 0) {
+            break;
+        }
+    }
+    return fseek(f, start, SEEK_SET) == 0 && fits;
+}
+
+//Loads a snapshot written by writeState over the whole machine. A delta goes on top of whatever is in RAM, which
+//should be its base, and marks the pages it brings in dirty. Only call while nothing is stepping ctx.
+static KARVStateResult readState(KARVContext *ctx, const char *path, uint64_t key, bool delta) {
+    if (!delta) {
+        KARVStateResult result = mapState(ctx, path, key);
+        if (result != STATE_MISSING) {
+            return result;
+        }
+    }
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return STATE_MISSING;
+    }
+    SnapshotHeader header;
+    if (!SnapshotReadHeader(f, key, MINI_RV32_RAM_SIZE, &header) || (header.baseId != 0) != delta) {
+        fclose(f);
+        return STATE_MISSING;
+    }
+    if (!streamedTermFits(ctx, f)) {
+        fclose(f);
+        return STATE_INVALID;
+    }
+
+    //A whole snapshot only has the non-zero pages, everything else has to go
+    if (!delta) {
+        clearRam(ctx);
+    }
+
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    KARVTermSnapshot term;
+    bool gotRAM = false;
+    bool gotTerm = false;
+    SnapshotSection section;
+    while (SnapshotReadSection(f, &section)) {
+        if (section.tag == SNAPSHOT_SECTION_END) {
+            fclose(f);
+            if (!gotRAM || !gotTerm) {
+                return STATE_DAMAGED;
+            }
+            restoreTerm(ctx, &term);
+            return STATE_RESTORED;
+        } else if (section.tag == SNAPSHOT_SECTION_RAM) {
+            if (!SnapshotReadRAM(f, &section, ctx->ram_image, MINI_RV32_RAM_SIZE, delta ? ctx->dirtyPages : NULL, 0xff)) {
+                break;
+            }
+            gotRAM = true;
+        } else if (section.tag == SNAPSHOT_SECTION_TERMINAL) {
+            if (section.size < sizeof(term) || fread(&term, sizeof(term), 1, f) != 1 ||
+                termSnapshotSize(ctx, &term) == 0 || section.size != sizeof(term) + termSnapshotSize(ctx, &term) ||
+                !restoreScreenMode(ctx, &term) ||
+                fread(tgState->rowMap, terminalTextSize(tgState), 1, f) != 1 ||
+                !rowMapValid((const uint8_t *)tgState->rowMap, tgState->rows) ||
+                fread(ctx->backBuffer, termPixelsSize(tgState), 1, f) != 1) {
+                break;
+            }
+            gotTerm = true;
+        } else {
+            break;
+        }
+    }
+    fclose(f);
+    return STATE_DAMAGED;
+}
+
+//Everything writeState needs from a computer, so it can also write a copy frozen at some earlier point
+typedef struct {
+    const uint8_t *ram;
+    const uint8_t *dirtyPages; //Only read for deltas
+    KARVTermSnapshot term;
+    const void *text;
+    size_t textSize;
+    const uint8_t *pixels;
+} KARVStateView;
+
+//Views ctx as it is right now, only valid until ctx is stepped again
+static void viewState(KARVContext *ctx, KARVStateView *view) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    memset(view, 0, sizeof(*view));
+    view->ram = ctx->ram_image;
+    view->dirtyPages = ctx->dirtyPages;
+    viewTerm(ctx, &view->term);
+    view->text = tgState->rowMap;
+    view->textSize = terminalTextSize(tgState);
+    view->pixels = ctx->backBuffer;
+
+    //The core lives at the end of RAM and changes with every step without going through a store, so it's part
+    //of every delta
+    MarkDirtyPages(ctx, (uint32_t)((uint8_t *)ctx->core - ctx->ram_image), sizeof(struct MiniRV32IMAState));
+}
+
+//Written to a temporary file first, so whatever was at path before stays whole if this fails half way,
+//and other computers starting up never see half a boot snapshot. With a baseId this writes a delta holding
+//only the pages dirty since that base.
+static bool writeState(const KARVStateView *view, const char *path, uint64_t key, uint64_t id, uint64_t baseId) {
+    size_t tmpPathSize = strlen(path) + 32;
+    char *tmpPath = malloc(tmpPathSize);
+    if (tmpPath == NULL) {
+        return false;
+    }
+    snprintf(tmpPath, tmpPathSize, "%s.%p.tmp", path, (void *)view);
+    FILE *f = fopen(tmpPath, "wb");
+    if (f == NULL) {
+        free(tmpPath);
+        return false;
+    }
+
+    size_t pixelsSize = view->term.width * view->term.height * formatBytesPerPixel(view->term.format);
+    bool ok = SnapshotWriteHeader(f, key, MINI_RV32_RAM_SIZE, id, baseId) &&
+              SnapshotWriteRAM(f, view->ram, MINI_RV32_RAM_SIZE, baseId != 0 ? view->dirtyPages : NULL, DIRTY_SAVE_STATE) &&
+              SnapshotBeginSection(f, SNAPSHOT_SECTION_TERMINAL, sizeof(view->term) + view->textSize + pixelsSize) &&
+              fwrite(&view->term, sizeof(view->term), 1, f) == 1 && fwrite(view->text, view->textSize, 1, f) == 1 &&
+              fwrite(view->pixels, pixelsSize, 1, f) == 1 &&
+              SnapshotWriteSection(f, SNAPSHOT_SECTION_END, NULL, 0);
+    ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+    //rename won't replace an existing file here
+    if (ok) {
+        remove(path);
+    }
+#endif
+    if (!ok || rename(tmpPath, path) != 0) {
+        remove(tmpPath);
+        free(tmpPath);
+        return false;
+    }
+    free(tmpPath);
+    return true;
+}
+
+//For after RAM was replaced, the screen already shows whatever the new framebuffer holds
+static void syncFramebuffer(KARVContext *ctx) {
+    const uint8_t *fb = ctx->ram_image + framebufferPage(ctx, ctx->shownPage);
+    memcpy(ctx->fbShadow, fb, termPixelsSize(&ctx->termGraphicsState));
+}
+
+//Powers the machine on: loads the kernel and DTB into zeroed RAM, then skips the boot itself if there's a boot
+//snapshot for them
+static void bootMachine(KARVContext *ctx, FILE *logFile) {
+    size_t kernelLen = loadMachine(ctx, logFile);
+    ctx->bootSnapshotPending = false;
+    ctx->idleSteps = 0;
+    ctx->baseId = 0;
+#ifndef KARV_NO_BOOT_SNAPSHOT
+    if (kernelLen > 0) {
+        char path[64];
+        ctx->bootKey = bootSnapshotKey(ctx, kernelLen);
+        bootSnapshotPath(ctx, path, sizeof(path));
+        KARVStateResult result = readState(ctx, path, ctx->bootKey, false);
+        if (result == STATE_RESTORED) {
+            fprintf(logFile, "Restored boot snapshot %016llx\n", (unsigned long long)ctx->bootKey);
+        } else {
+            if (result == STATE_DAMAGED || result == STATE_INVALID) {
+                fprintf(logFile, "Error: boot snapshot is damaged, booting from scratch\n");
+            }
+            if (result == STATE_DAMAGED) {
+                clearRam(ctx);
+                loadMachine(ctx, logFile);
+                resetScreen(ctx);
+            }
+            ctx->bootSnapshotPending = true;
+        }
+    }
+#else
+    (void)kernelLen;
+#endif
+    syncFramebuffer(ctx);
+}
+
+#ifndef KARV_NO_BOOT_SNAPSHOT
+static void saveBootSnapshot(KARVContext *ctx) {
+    char path[64];
+    bootSnapshotPath(ctx, path, sizeof(path));
+    //If this fails, another computer with the same kernel might have beaten us to it, which is just as good
+    KARVStateView view;
+    viewState(ctx, &view);
+    if (writeState(&view, path, ctx->bootKey, ctx->bootKey, 0) && ctx->logFile != NULL) {
+        fprintf(ctx->logFile, "Saved boot snapshot %s\n", path);
+    }
+}
+#endif
+
+//Something no other save state is going to have, deltas use it to find their base
+static uint64_t newStateId(KARVContext *ctx) {
+    struct { double time; void *ctx; uint64_t baseId; int numLoops; } seed = { OGGetAbsoluteTime(), ctx, ctx->baseId, ctx->numLoops };
+    uint64_t id = SnapshotHash(SNAPSHOT_HASH_SEED, &seed, sizeof(seed));
+    return id != 0 ? id : 1;
+}
+
+//Saves the whole machine to path, returns 0 on success. The save becomes the base later deltas are written
+//against. Only call while nothing is stepping ctx.
+int karv_save_state(KARVContext *ctx, const char *path) {
+    KARVStateView view;
+    viewState(ctx, &view);
+    uint64_t id = newStateId(ctx);
+    if (!writeState(&view, path, SAVE_STATE_KEY, id, 0)) {
+        return -1;
+    }
+    ctx->baseId = id;
+    clearDirty(ctx, DIRTY_SAVE_STATE);
+    return 0;
+}
+
+//Saves only the pages written since the last karv_save_state (or the base karv_load_state* last loaded), so it's
+//much smaller and quicker than a whole save while the guest hasn't touched much of its RAM. Deltas don't build
+//on each other, each one only needs its base. Returns 0 on success, or -1 if there's no base to go on top of.
+//Only call while nothing is stepping ctx.
+int karv_save_state_delta(KARVContext *ctx, const char *path) {
+    if (ctx->baseId == 0) {
+        return -1;
+    }
+    KARVStateView view;
+    viewState(ctx, &view);
+    return writeState(&view, path, SAVE_STATE_KEY, newStateId(ctx), ctx->baseId) ? 0 : -1;
+}
+
+//A save frozen at the moment it was started and written out on a thread of its own, see karv_save_state_async
+typedef struct {
+    KARVContext *ctx;
+    WorkThread *thread;
+    KARVStateView view;
+    uint8_t *ram;
+    uint8_t *dirtyPages; //ctx's as they were, deltas read them and a whole save puts them back if it fails
+    void *text;
+    uint8_t *pixels;
+    char *path;
+    uint64_t id;
+    uint64_t baseId;
+    uint64_t prevBaseId; //ctx's base before a whole save made itself the base
+    bool ok;
+} KARVSaveJob;
+
+static void freeSaveJob(KARVSaveJob *job) {
+    WorkThreadDestroy(job->thread);
+    GuestRamFree(job->ram, MINI_RV32_RAM_SIZE);
+    free(job->dirtyPages);
+    free(job->text);
+    free(job->pixels);
+    free(job->path);
+    free(job);
+}
+
+static void runSaveJob(void *userData) {
+    KARVSaveJob *job = userData;
+    job->ok = writeState(&job->view, job->path, SAVE_STATE_KEY, job->id, job->baseId);
+}
+
+//Copies ctx into a new job and starts writing it. The copy costs little: RAM ends up shared copy-on-write with
+//ctx where the host allows it (see copyRam), otherwise only the pages the save needs get copied.
+static KARVSaveJob *startSaveJob(KARVContext *ctx, const char *path, bool delta) {
+    if (delta && ctx->baseId == 0) {
+        return NULL;
+    }
+    KARVSaveJob *job = calloc(1, sizeof(KARVSaveJob));
+    if (job == NULL) {
+        return NULL;
+    }
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    size_t textSize = terminalTextSize(tgState);
+    size_t pixelsSize = termPixelsSize(tgState);
+    job->ctx = ctx;
+    job->thread = WorkThreadCreate();
+    job->ram = GuestRamAlloc(MINI_RV32_RAM_SIZE);
+    job->dirtyPages = malloc(NUM_RAM_PAGES);
+    job->text = malloc(textSize);
+    job->pixels = malloc(pixelsSize);
+    job->path = malloc(strlen(path) + 1);
+    if (job->thread == NULL || job->ram == NULL || job->dirtyPages == NULL || job->text == NULL || job->pixels == NULL ||
+        job->path == NULL) {
+        freeSaveJob(job);
+        return NULL;
+    }
+    strcpy(job->path, path);
+
+    viewState(ctx, &job->view);
+    copyRam(ctx, job->ram, NULL, delta ? DIRTY_SAVE_STATE : 0);
+    memcpy(job->dirtyPages, ctx->dirtyPages, NUM_RAM_PAGES);
+    memcpy(job->text, tgState->rowMap, textSize);
+    memcpy(job->pixels, ctx->backBuffer, pixelsSize);
+    job->view.ram = job->ram;
+    job->view.dirtyPages = job->dirtyPages;
+    job->view.text = job->text;
+    job->view.pixels = job->pixels;
+
+    job->id = newStateId(ctx);
+    if (delta) {
+        job->baseId = ctx->baseId;
+    } else {
+        //Deltas from here on go on top of this save, even before it's finished
+        job->prevBaseId = ctx->baseId;
+        ctx->baseId = job->id;
+        clearDirty(ctx, DIRTY_SAVE_STATE);
+    }
+    WorkThreadStart(job->thread, runSaveJob, job);
+    return job;
+}
+
+//karv_save_state, except the file gets written on a background thread while ctx keeps running. Returns a handle
+//for karv_save_ready and karv_save_wait (which has to be called exactly once, before ctx is destroyed), or NULL
+//if the save couldn't be started. Only call while nothing is stepping ctx.
+KARVSaveJob *karv_save_state_async(KARVContext *ctx, const char *path) {
+    return startSaveJob(ctx, path, false);
+}
+
+//karv_save_state_delta on a background thread, the same as karv_save_state_async. NULL if there's no base.
+KARVSaveJob *karv_save_state_delta_async(KARVContext *ctx, const char *path) {
+    return startSaveJob(ctx, path, true);
+}
+
+//Nonzero once the save is written, so karv_save_wait won't block
+int karv_save_ready(KARVSaveJob *job) {
+    return WorkThreadIsDone(job->thread);
+}
+
+//Waits for the save to be written and frees job. Returns 0 if it was saved. Only call while nothing is stepping the
+//computer it was started on.
+int karv_save_wait(KARVSaveJob *job) {
+    WorkThreadWait(job->thread);
+    bool ok = job->ok;
+    KARVContext *ctx = job->ctx;
+    if (!ok && job->baseId == 0 && ctx->baseId == job->id) {
+        //Nothing can go on top of a save that doesn't exist, go back to the last base
+        ctx->baseId = job->prevBaseId;
+        for (uint32_t page=0; page<NUM_RAM_PAGES; page++) {
+            ctx->dirtyPages[page] |= job->dirtyPages[page] & DIRTY_SAVE_STATE;
+        }
+    }
+    freeSaveJob(job);
+    return ok ? 0 : -1;
+}
+
+//Loads basePath, then deltaPath (if not NULL) on top of it
+static int loadState(KARVContext *ctx, const char *basePath, const char *deltaPath) {
+    SnapshotHeader base;
+    SnapshotHeader delta;
+    if (!peekState(basePath, SAVE_STATE_KEY, &base) || base.baseId != 0 ||
+        (deltaPath != NULL && (!peekState(deltaPath, SAVE_STATE_KEY, &delta) || delta.baseId != base.id))) {
+        return -1;
+    }
+
+    KARVStateResult result = readState(ctx, basePath, SAVE_STATE_KEY, false);
+    if (result == STATE_INVALID) {
+        FILE *logFile = ctx->logFile != NULL ? ctx->logFile : stderr;
+        fprintf(logFile, "Error: save state %s is damaged, nothing was loaded\n", basePath);
+    }
+    if (result == STATE_MISSING || result == STATE_INVALID) {
+        return -1; //Still the computer it was, dirty pages and all
+    }
+    memset(ctx->dirtyPages, 0, NUM_RAM_PAGES);
+    if (result == STATE_RESTORED && deltaPath != NULL) {
+        result = readState(ctx, deltaPath, SAVE_STATE_KEY, true);
+        if (result == STATE_MISSING || result == STATE_INVALID) {
+            result = STATE_DAMAGED; //It was fine a moment ago, and the base is already loaded
+        }
+    }
+#ifndef KARV_REFERENCE_CORE
+    //Every cached block was decoded from the RAM that just got replaced
+    FastCoreFlush(&ctx->fastCore);
+#endif
+    if (result == STATE_DAMAGED) {
+        FILE *logFile = ctx->logFile != NULL ? ctx->logFile : stderr;
+        fprintf(logFile, "Error: save state %s is damaged, rebooting\n", deltaPath != NULL ? deltaPath : basePath);
+        clearRam(ctx);
+        resetScreen(ctx);
+        bootMachine(ctx, logFile);
+        return -1;
+    }
+    //Whatever this was booting is gone, don't save the loaded machine as a boot snapshot
+    ctx->bootSnapshotPending = false;
+    ctx->idleSteps = 0;
+    ctx->baseId = base.id;
+    syncFramebuffer(ctx);
+    return 0;
+}
+
+//Replaces the whole machine with one saved by karv_save_state, returns 0 on success. If path doesn't hold a
+//save state, or holds one found to be broken before loading starts, nothing changes. If it turns out damaged
+//while loading the computer is rebooted. Only call while nothing is stepping ctx.
+int karv_load_state(KARVContext *ctx, const char *path) {
+    return loadState(ctx, path, NULL);
+}
+
+//Same as karv_load_state, for a delta saved by karv_save_state_delta and the save state it was written against.
+//Nothing changes if deltaPath wasn't written against basePath.
+int karv_load_state_delta(KARVContext *ctx, const char *basePath, const char *deltaPath) {
+    return loadState(ctx, basePath, deltaPath);
+}
+
+//The guest is asleep in WFI and only the timer can wake it, so calling the core again would just add
+//STEP_ELAPSED_US and return. Jumps the timer ahead by as many of those calls as it takes for the next one to
+//fire the interrupt, leaving the guest exactly where the calls would have. Returns false if the guest won't
+//wake within idleLeftUs (the timer is still moved as far as that allows).
+static bool skipIdleTime(struct MiniRV32IMAState *core, uint64_t *idleLeftUs) {
+    uint64_t timer = ((uint64_t)core->timerh << 32) | core->timerl;
+    uint64_t match = ((uint64_t)core->timermatchh << 32) | core->timermatchl;
+    if (match == 0) {
+        return false; //No timer set, nothing is ever going to wake it
+    }
+    uint64_t calls = timer < match ? (match - timer) / STEP_ELAPSED_US : 0;
+    uint64_t maxCalls = *idleLeftUs / STEP_ELAPSED_US;
+    bool wakes = calls < maxCalls;
+    if (!wakes) {
+        calls = maxCalls;
+    }
+    timer += calls * STEP_ELAPSED_US;
+    core->timerh = timer >> 32;
+    core->timerl = (uint32_t)timer;
+    *idleLeftUs -= wakes ? (calls + 1) * STEP_ELAPSED_US : calls * STEP_ELAPSED_US;
+    return wakes;
+}
+
+//Copies pixels [start, end) that differ from the shadow into dst (where start goes) and the shadow, widening
+//[*first, *last] to cover them
+#define COPY_CHANGED_PIXELS(type, fb, shadow, dst, start, end, first, last) \
+    for (uint32_t i=(start); i<(end); i++) { \
+        if (((const type *)(fb))[i] != ((type *)(shadow))[i]) { \
+            ((type *)(shadow))[i] = ((const type *)(fb))[i]; \
+            ((type *)(dst))[i - (start)] = ((const type *)(fb))[i]; \
+            *(first) = i < *(first) ? i : *(first); \
+            *(last) = i; \
+        } \
+    }
+
+//Draws the pixels the guest changed in its framebuffer onto the screen, over the text written before them. The pages
+//it wrote are found through DIRTY_FRAMEBUFFER and the pixels in them by comparing with fbShadow, so a page written
+//to doesn't paint over text with pixels the guest never touched.
+static void drawFramebuffer(KARVContext *ctx) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    const uint8_t *fb = ctx->ram_image + framebufferPage(ctx, ctx->shownPage);
+    uint8_t *shadow = ctx->fbShadow;
+    uint32_t numPixels = tgState->width * tgState->height;
+    uint8_t *dirty = ctx->dirtyPages + framebufferPage(ctx, ctx->shownPage) / SNAPSHOT_PAGE_SIZE;
+    const int bytesPerPixel = tgState->bytesPerPixel;
+    const uint32_t pagePixels = SNAPSHOT_PAGE_SIZE / bytesPerPixel;
+    bool drewText = false;
+    for (uint32_t page=0; page*pagePixels < numPixels; page++) {
+        if (!(dirty[page] & DIRTY_FRAMEBUFFER)) {
+            continue;
+        }
+        dirty[page] &= ~DIRTY_FRAMEBUFFER;
+        if (!drewText) {
+            drawDirtyCells(tgState);
+            drewText = true;
+        }
+        uint32_t end = (page + 1) * pagePixels < numPixels ? (page + 1) * pagePixels : numPixels;
+        //A row of pixels at a time, each is in one piece in vram
+        for (uint32_t rowStart=page*pagePixels; rowStart<end; ) {
+            uint32_t rowEnd = (rowStart / tgState->width + 1) * tgState->width;
+            rowEnd = rowEnd < end ? rowEnd : end;
+            uint8_t *dst = tgState->vram + screenToVram(tgState, rowStart * bytesPerPixel);
+            uint32_t first = rowEnd;
+            uint32_t last = rowStart;
+            if (bytesPerPixel == 4) {
+                COPY_CHANGED_PIXELS(uint32_t, fb, shadow, dst, rowStart, rowEnd, &first, &last);
+            } else if (bytesPerPixel == 2) {
+                COPY_CHANGED_PIXELS(uint16_t, fb, shadow, dst, rowStart, rowEnd, &first, &last);
+            } else {
+                COPY_CHANGED_PIXELS(uint8_t, fb, shadow, dst, rowStart, rowEnd, &first, &last);
+            }
+            if (first < rowEnd) {
+                damageBytes(tgState, first * bytesPerPixel, (last - first + 1) * bytesPerPixel);
+            }
+            rowStart = rowEnd;
+        }
+    }
+}
+
+//Runs up to targetSteps instructions, stopping early once OGGetAbsoluteTime passes deadline (0 for no deadline).
+//Also returns early, with statusCode 1, once the guest has slept through IDLE_US_PER_STEP.
+static stepRetVal runSteps(KARVContext *ctx, char *kbBuffer, int32_t len, uint32_t targetSteps, double deadline, uint32_t *stepsRun) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+
+    ctx->keyboardBuffer = kbBuffer;
+    ctx->kbBufferLen = len;
+
+    ctx->numLoops += 1;
+    ctx->blitBytesLeft = BLIT_BYTES_PER_STEP;
     stepRetVal ret;
-    int numRunTotal = 0;
+    ret.statusCode = 0;
+    ret.kbBufferLen = len;
+    uint32_t numRunTotal = 0;
+    uint32_t sliceEnd = deadline > 0.0 ? DEADLINE_CHECK_STEPS : targetSteps;
+    uint64_t idleLeftUs = IDLE_US_PER_STEP;
     while (numRunTotal < targetSteps) {
         //printf("%d\n", numRunTotal);
         int numRun = 0;
-        ret.statusCode = MiniRV32IMAStep(core, ram_image, 0, 1024, (targetSteps)-numRunTotal, &numRun);
-        ret.kbBufferLen = kbBufferLen;
+        uint32_t sliceSteps = (sliceEnd < targetSteps ? sliceEnd : targetSteps) - numRunTotal;
+        ret.statusCode = KARV_CORE_STEP(ctx, ctx->core, ctx->ram_image, 0, STEP_ELAPSED_US, sliceSteps, &numRun);
+        ret.kbBufferLen = ctx->kbBufferLen;
         numRunTotal += numRun;
+        if (ret.statusCode == 1 && (ctx->core->extraflags & 4)) {
+            //Sleeping, skip straight to the timer interrupt instead of spinning until it comes
+            if (!skipIdleTime(ctx->core, &idleLeftUs)) {
+                break;
+            }
+        }
+        if (numRunTotal >= sliceEnd && numRunTotal < targetSteps) {
+            if (OGGetAbsoluteTime() > deadline) {
+                break;
+            }
+            sliceEnd = numRunTotal + DEADLINE_CHECK_STEPS;
+        }
+    }
+    ctx->keyboardBuffer = NULL;
+
+    if (ctx->lazyState != NULL && ctx->lazyState->damaged) {
+        FILE *logFile = ctx->logFile != NULL ? ctx->logFile : stderr;
+        fprintf(logFile, "Error: pages of the loaded snapshot are damaged, they read as zero\n");
+        ctx->lazyState->damaged = 0;
     }
     
-    if (numLoops % 30 >= 15) {
-        drawChar(&termGraphicsState, termGraphicsState.cursorX, termGraphicsState.cursorY, 219);
+    //Only now does what the guest drew during the step get onto the screen, text once however often it scrolled by
+    drawFramebuffer(ctx);
+    drawTerminal(tgState, ctx->numLoops % 30 >= 15);
+    if (stepsRun != NULL) {
+        *stepsRun = numRunTotal;
+    }
+
+#ifndef KARV_NO_BOOT_SNAPSHOT
+    if (ctx->bootSnapshotPending) {
+        ctx->idleSteps = ret.statusCode == 1 ? ctx->idleSteps + 1 : 0;
+        if (ctx->idleSteps >= BOOT_SNAPSHOT_IDLE_STEPS) {
+            saveBootSnapshot(ctx);
+            ctx->bootSnapshotPending = false;
+        }
+    }
+#endif
+    return ret;
+}
+
+//Brings the front buffer up to date with the finished frame, copying only what changed, and hands the caller a
+//copy of it in vram unless that's NULL. Only call this while nothing is stepping ctx.
+static void presentFrame(KARVContext *ctx, uint8_t *vram) {
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    KARVScreenMode mode;
+    currentMode(ctx, &mode);
+    if (memcmp(&mode, &ctx->frontMode, sizeof(mode)) != 0) {
+        //Gives back the pages the old mode used, a new mode is damaged all over so the whole screen gets copied
+        GuestRamClear(ctx->frontBuffer, screenBudget(ctx));
+        ctx->frontMode = mode;
+    }
+    ctx->numDamage = takeDamage(tgState, ctx->damage, MAX_DAMAGE_RECTS);
+    for (int i=0; i<ctx->numDamage; i++) {
+        copyScreenRect(tgState, ctx->frontBuffer, &ctx->damage[i]);
+    }
+    if (ctx->paletteChanged) {
+        memcpy(ctx->frontPalette, ctx->palette, sizeof(ctx->palette));
+        ctx->paletteChanged = false;
+        if (mode.format == SCREEN_FORMAT_INDEXED8) {
+            //Every pixel looks different now
+            ctx->damage[0] = (TermRect){ 0, 0, tgState->width, tgState->height };
+            ctx->numDamage = 1;
+        }
+    }
+    if (ctx->numDamage > 0) {
+        ctx->frameGeneration++;
+    }
+    ctx->framesPresented++;
+    if (vram != NULL) {
+        memcpy(vram, ctx->frontBuffer, termPixelsSize(tgState));
+    }
+}
+
+//The screen as of the last finished step, in the mode karv_get_screen_mode gives, in a page aligned buffer libkarv
+//owns. The pointer stays the same until karv_destroy, and the pixels only change when karv_step, karv_step_wait or
+//a batch returns, so they can be read (or uploaded from) while ctx is stepping in the background.
+const uint8_t *karv_get_framebuffer(KARVContext *ctx) {
+    return ctx->frontBuffer;
+}
+
+//The mode karv_get_framebuffer's pixels are in: width*height of them, rows one after another, 4 bytes each in
+//format 0 (RGBA8888), 2 in format 1 (RGB565, red in the top bits) and 1 in format 2 (8 bit indexes into
+//karv_get_palette). It only changes along with the frame generation, and then the whole frame is damaged. The
+//guest can pick any mode that takes at most as many bytes as the size ctx was created with at RGBA8888.
+void karv_get_screen_mode(KARVContext *ctx, KARVScreenMode *mode) {
+    *mode = ctx->frontMode;
+}
+
+//The 256 RGBA colours format 2 pixels index, as of the last finished step like the pixels. A frame that only
+//changed the palette is still a new frame, damaged all over.
+const uint32_t *karv_get_palette(KARVContext *ctx) {
+    return ctx->frontPalette;
+}
+
+//Converts karv_get_framebuffer's pixels to RGBA in dst, for hosts that can't show the screen's format as it is.
+//dst needs width*height*4 bytes, which for format 2 can be up to 4 times what the screen was created with.
+void karv_frame_to_rgba(KARVContext *ctx, uint8_t *dst) {
+    uint32_t numPixels = ctx->frontMode.width * ctx->frontMode.height;
+    if (ctx->frontMode.format == SCREEN_FORMAT_RGB565) {
+        const uint16_t *src = (const uint16_t *)ctx->frontBuffer;
+        for (uint32_t i=0; i<numPixels; i++) {
+            uint8_t r = src[i] >> 11;
+            uint8_t g = (src[i] >> 5) & 0x3f;
+            uint8_t b = src[i] & 0x1f;
+            dst[i*4+0] = r << 3 | r >> 2;
+            dst[i*4+1] = g << 2 | g >> 4;
+            dst[i*4+2] = b << 3 | b >> 2;
+            dst[i*4+3] = 255;
+        }
+    } else if (ctx->frontMode.format == SCREEN_FORMAT_INDEXED8) {
+        for (uint32_t i=0; i<numPixels; i++) {
+            memcpy(dst + i*4, &ctx->frontPalette[ctx->frontBuffer[i]], 4);
+        }
     } else {
-        drawChar(&termGraphicsState, termGraphicsState.cursorX, termGraphicsState.cursorY, ' ');
+        memcpy(dst, ctx->frontBuffer, numPixels * 4);
+    }
+}
+
+//Goes up by one for every frame that changed karv_get_framebuffer's pixels. Seeing it one past the generation
+//last uploaded means karv_get_damage covers everything that changed, any further and the whole frame should go.
+uint64_t karv_get_frame_generation(KARVContext *ctx) {
+    return ctx->frameGeneration;
+}
+
+//Fills rects with the parts of the screen that the last frame (from karv_step, karv_step_wait or a batch) changed,
+//so only those need uploading. Returns how many it filled, 0 if nothing changed. If it would take more than max
+//(at least 1) rects, the one rect covering all of them is given. The first frame, and the first after a load, is
+//damaged all over. Only call while nothing is stepping ctx.
+int karv_get_damage(KARVContext *ctx, TermRect *rects, int max) {
+    if (max <= 0 || ctx->numDamage == 0) {
+        return 0;
+    }
+    if (ctx->numDamage <= max) {
+        memcpy(rects, ctx->damage, ctx->numDamage * sizeof(TermRect));
+        return ctx->numDamage;
+    }
+    int right = 0;
+    int bottom = 0;
+    rects[0] = ctx->damage[0];
+    for (int i=0; i<ctx->numDamage; i++) {
+        const TermRect *rect = &ctx->damage[i];
+        rects[0].x = rect->x < rects[0].x ? rect->x : rects[0].x;
+        right = rect->x + rect->width > right ? rect->x + rect->width : right;
+        bottom = rect->y + rect->height > bottom ? rect->y + rect->height : bottom;
     }
+    //Sorted top to bottom, so the first rect starts highest
+    rects[0].width = right - rects[0].x;
+    rects[0].height = bottom - rects[0].y;
+    return 1;
+}
+
+stepRetVal karv_step(KARVContext *ctx, uint8_t *vram, char *kbBuffer, int32_t len, uint32_t targetSteps) {
+    stepRetVal ret = runSteps(ctx, kbBuffer, len, targetSteps, 0.0, NULL);
+    presentFrame(ctx, vram);
     return ret;
 }
 
-void cleanup() {
-    fclose(logFile);
-    free(ram_image);
-    stbi_image_free(termGraphicsState.font);
+static void runAsyncStep(void *userData) {
+    KARVContext *ctx = userData;
+    ctx->asyncRet = runSteps(ctx, ctx->asyncKB, ctx->asyncKBLen, ctx->asyncTargetSteps, 0.0, NULL);
+}
+
+//Starts stepping ctx on its own thread and returns straight away. The keyboard input is copied, so
+//kbBuffer can be reused right after this returns. Returns -1 if the previous step hasn't been waited for.
+int karv_step_async(KARVContext *ctx, char *kbBuffer, int32_t len, uint32_t targetSteps) {
+    if (ctx->asyncThread == NULL) {
+        ctx->asyncThread = WorkThreadCreate();
+        if (ctx->asyncThread == NULL) {
+            return -1;
+        }
+    }
+    if (!WorkThreadIsIdle(ctx->asyncThread)) {
+        return -1;
+    }
+
+    if (len > ctx->asyncKBCapacity) {
+        char *grown = realloc(ctx->asyncKB, len);
+        if (grown == NULL) {
+            return -1;
+        }
+        ctx->asyncKB = grown;
+        ctx->asyncKBCapacity = len;
+    }
+    if (len > 0) {
+        memcpy(ctx->asyncKB, kbBuffer, len);
+    }
+    ctx->asyncKBLen = len;
+    ctx->asyncTargetSteps = targetSteps;
+    WorkThreadStart(ctx->asyncThread, runAsyncStep, ctx);
+    return 0;
+}
+
+//Nonzero once the step started by karv_step_async has finished, so karv_step_wait won't block
+int karv_step_ready(KARVContext *ctx) {
+    return ctx->asyncThread != NULL && WorkThreadIsDone(ctx->asyncThread);
+}
+
+//Waits for the step started by karv_step_async, then copies its finished frame into vram (NULL to skip that), as
+//karv_get_framebuffer has it. However the guest sets the screen up that fits in width*height*4 bytes of the size ctx
+//was created with.
+//kbBufferLen in the result counts what's left of the input given to karv_step_async.
+stepRetVal karv_step_wait(KARVContext *ctx, uint8_t *vram) {
+    if (ctx->asyncThread == NULL || !WorkThreadWait(ctx->asyncThread)) {
+        stepRetVal ret;
+        ret.statusCode = -1;
+        ret.kbBufferLen = 0;
+        return ret;
+    }
+    presentFrame(ctx, vram);
+    return ctx->asyncRet;
+}
+
+//One computer's share of a karv_step_batch, the arguments of karv_step plus what it returned
+typedef struct {
+    KARVContext *ctx;
+    uint8_t *vram;
+    char *kbBuffer;
+    int32_t kbBufferLen;
+    uint32_t targetSteps;
+    stepRetVal ret;
+    uint32_t stepsRun; //Less than targetSteps if the deadline passed first
+} KARVStepJob;
+
+typedef struct {
+    KARVStepJob *jobs;
+    int32_t numJobs;
+    double deadline;
+} KARVBatch;
+
+typedef struct {
+    WorkPool *workers;
+    WorkThread *background; //Runs the batches from karv_step_batch_async, started on first use
+    KARVBatch batch;
+} KARVPool;
+
+static void runBatchJob(void *userData, int item) {
+    KARVBatch *batch = userData;
+    KARVStepJob *job = &batch->jobs[item];
+    job->ret = runSteps(job->ctx, job->kbBuffer, job->kbBufferLen, job->targetSteps, batch->deadline, &job->stepsRun);
+}
+
+static void runBatch(void *userData) {
+    KARVPool *pool = userData;
+    WorkPoolRun(pool->workers, runBatchJob, &pool->batch, pool->batch.numJobs);
+}
+
+static void setupBatch(KARVPool *pool, KARVStepJob *jobs, int32_t numJobs, uint32_t deadlineUs) {
+    pool->batch.jobs = jobs;
+    pool->batch.numJobs = numJobs;
+    pool->batch.deadline = deadlineUs > 0 ? OGGetAbsoluteTime() + deadlineUs / 1000000.0 : 0.0;
+}
+
+static void presentBatch(KARVBatch *batch) {
+    for (int32_t i=0; i<batch->numJobs; i++) {
+        presentFrame(batch->jobs[i].ctx, batch->jobs[i].vram);
+    }
 }
 
-static void DumpState( struct MiniRV32IMAState * core, uint8_t * ram_image )
+//numThreads <= 0 sizes the pool to the host's cores, the calling thread counts as one of them
+KARVPool *karv_pool_create(int numThreads) {
+    KARVPool *pool = calloc(1, sizeof(KARVPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = WorkPoolCreate(numThreads);
+    return pool;
+}
+
+//Steps every job's computer in parallel, each context may only appear once. Returns when they all ran
+//their targetSteps, or soon after deadlineUs microseconds have passed (0 for no deadline).
+void karv_step_batch(KARVPool *pool, KARVStepJob *jobs, int32_t numJobs, uint32_t deadlineUs) {
+    setupBatch(pool, jobs, numJobs, deadlineUs);
+    runBatch(pool);
+    presentBatch(&pool->batch);
+}
+
+//karv_step_batch without blocking, the batch runs on a background thread (standing in for the calling
+//thread's share of the work). jobs and every kbBuffer in it must stay valid until karv_step_batch_wait,
+//vram isn't touched until then. Returns -1 if the previous batch hasn't been waited for.
+int karv_step_batch_async(KARVPool *pool, KARVStepJob *jobs, int32_t numJobs, uint32_t deadlineUs) {
+    if (pool->background == NULL) {
+        pool->background = WorkThreadCreate();
+        if (pool->background == NULL) {
+            return -1;
+        }
+    }
+    if (!WorkThreadIsIdle(pool->background)) {
+        return -1;
+    }
+    setupBatch(pool, jobs, numJobs, deadlineUs);
+    WorkThreadStart(pool->background, runBatch, pool);
+    return 0;
+}
+
+//Nonzero once the batch started by karv_step_batch_async has finished
+int karv_step_batch_ready(KARVPool *pool) {
+    return pool->background != NULL && WorkThreadIsDone(pool->background);
+}
+
+//Waits for the batch started by karv_step_batch_async, then fills in every job's vram with its finished frame
+void karv_step_batch_wait(KARVPool *pool) {
+    if (pool->background != NULL && WorkThreadWait(pool->background)) {
+        presentBatch(&pool->batch);
+    }
+}
+
+void karv_pool_destroy(KARVPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    WorkThreadDestroy(pool->background);
+    WorkPoolDestroy(pool->workers);
+    free(pool);
+}
+
+void karv_destroy(KARVContext *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    WorkThreadDestroy(ctx->asyncThread);
+    free(ctx->asyncKB);
+    if (ctx->logFile != NULL) {
+        fclose(ctx->logFile);
+    }
+    GuestRamFree(ctx->ram_image, MINI_RV32_RAM_SIZE);
+    GuestRamCloseImage(ctx->ramImage);
+    freeLazyState(ctx);
+    free(ctx->dirtyPages);
+    freeTerminal(&ctx->termGraphicsState);
+    free(ctx->backBuffer);
+    GuestRamFree(ctx->frontBuffer, screenBudget(ctx));
+    GuestRamFree(ctx->fbShadow, termPixelsSize(&ctx->termGraphicsState));
+#ifndef KARV_REFERENCE_CORE
+    FastCoreFree(&ctx->fastCore);
+#endif
+    free(ctx);
+}
+
+static void DumpState( KARVContext *ctx )
 {
+	struct MiniRV32IMAState *core = ctx->core;
+	FILE *logFile = ctx->logFile != NULL ? ctx->logFile : stdout;
 	uint32_t pc = core->pc;
 	uint32_t pc_offset = pc - MINIRV32_RAM_IMAGE_OFFSET;
 	uint32_t ir = 0;
@@ -195,7 +1754,7 @@ static void DumpState( struct MiniRV32IMAState * core, uint8_t * ram_image )
 	fprintf( logFile, "PC: %08x ", pc );
 	if( pc_offset >= 0 && pc_offset < MINI_RV32_RAM_SIZE - 3 )
 	{
-		ir = *((uint32_t*)(&((uint8_t*)ram_image)[pc_offset]));
+		ir = *((uint32_t*)(&((uint8_t*)ctx->ram_image)[pc_offset]));
 		fprintf( logFile, "[0x%08x] ", ir );
 	}
 	else
@@ -306,10 +1865,10 @@ void HandleMotion(int x, int y, int mask) {
 void HandleDestroy() {}
 
 int main() {
-    setup(600, 600);
+    KARVContext *ctx = karv_create(600, 600, "rvlog.txt");
     CNFGSetup("KARV external test program", 600, 600);
     printf("start\n");
-    uint32_t vram[600*600];
+    static uint32_t vram[600*600*4]; //As many pixels as a guest mode can have, at 8 bits each
     
     int running = 1;
     for (int i=0; CNFGHandleInput() != 0 && running; i++) {
@@ -320,7 +1879,7 @@ int main() {
             if (stepMode) {
                 stepsPerTick = 1;
             }
-            stepRetVal ret = step((uint8_t*)vram, globalKBBuffer, globalKBBufferLen, stepsPerTick);
+            stepRetVal ret = karv_step(ctx, NULL, globalKBBuffer, globalKBBufferLen, stepsPerTick);
         
             globalKBBufferLen = ret.kbBufferLen;
             switch( ret.statusCode )
@@ -329,18 +1888,21 @@ int main() {
                 case 1: break;//if( do_sleep ) MiniSleep(); *this_ccount += instrs_per_flip; break;
                 case 3: break;//instct = 0; break;
                 case 0x7777: printf("Tried to restart\n");	//syscon code for restart
-                case 0x5555: printf( "POWEROFF@0x%08x%08x\n", core->cycleh, core->cyclel ); running = 0; break; //syscon code for power-off
+                case 0x5555: printf( "POWEROFF@0x%08x%08x\n", ctx->core->cycleh, ctx->core->cyclel ); running = 0; break; //syscon code for power-off
                 default: printf( "Unknown failure\n" ); break;
             }
             
             if (stepMode) {
-                DumpState(core, ram_image);
+                DumpState(ctx);
                 stepNow = false;
             }
         }
 		
+		KARVScreenMode mode;
+		karv_get_screen_mode(ctx, &mode);
+		karv_frame_to_rgba(ctx, (uint8_t*)vram);
 		CNFGClearFrame();
-		CNFGBlitImage(vram, 0, 0, 600, 600);
+		CNFGBlitImage(vram, 0, 0, mode.width, mode.height);
         CNFGSwapBuffers();
         
         double newTime = OGGetAbsoluteTime();
@@ -351,11 +1913,11 @@ int main() {
     }
     printf("stop\n");
 
-    cleanup();
+    karv_destroy(ctx);
 }
 #endif
 
-static int ReadKBByte()
+static int ReadKBByte( KARVContext *ctx )
 {
 	/*if( is_eofd ) return 0xffffffff;
 	char rxchar = 0;
@@ -366,97 +1928,203 @@ static int ReadKBByte()
 	else
 		return -1;*/
 
-    if (kbBufferLen < 1) {
+    if (ctx->kbBufferLen < 1) {
         return -1;
     }
-    char c = keyboardBuffer[0];
-    for (int i=0; i<kbBufferLen-1; i++) {
-        keyboardBuffer[i] = keyboardBuffer[i+1];
+    char c = ctx->keyboardBuffer[0];
+    for (int i=0; i<ctx->kbBufferLen-1; i++) {
+        ctx->keyboardBuffer[i] = ctx->keyboardBuffer[i+1];
     }
-    kbBufferLen -= 1;
+    ctx->kbBufferLen -= 1;
     return c;
 }
 
-static int IsKBHit()
+static int IsKBHit( KARVContext *ctx )
 {
 	/*if( is_eofd ) return -1;
 	int byteswaiting;
 	ioctl(0, FIONREAD, &byteswaiting);
 	if( !byteswaiting && write( fileno(stdin), 0, 0 ) != 0 ) { is_eofd = 1; return -1; } // Is end-of-file for
 	return !!byteswaiting;*/
-    return kbBufferLen > 0;
+    return ctx->kbBufferLen > 0;
 }
 
-static uint32_t HandleControlStore( uint32_t addy, uint32_t val )
+//Switches the screen to the mode the guest staged, if it fits. The screen starts out blank, and what's already in
+//the framebuffer only shows once the guest writes it again.
+static void applyStagedMode( KARVContext *ctx )
+{
+    ctx->modeTaken = screenModeFits(ctx, &ctx->stagedMode) && setScreenMode(ctx, &ctx->stagedMode);
+    if (ctx->modeTaken) {
+        syncFramebuffer(ctx);
+    } else if (ctx->logFile != NULL) {
+        fprintf(ctx->logFile, "Guest asked for a %ux%u screen in format %u, which doesn't fit\n",
+                ctx->stagedMode.width, ctx->stagedMode.height, ctx->stagedMode.format);
+        fflush(ctx->logFile);
+    }
+}
+
+//An upper bound on what cmd costs out of BLIT_BYTES_PER_STEP, clipping only ever makes it cheaper
+static uint64_t blitCost(const TermGraphicsState *tgState, const BlitCommand *cmd) {
+    uint64_t width = cmd->size & 0xffff;
+    uint64_t height = cmd->size >> 16;
+    width = width < tgState->width ? width : tgState->width;
+    height = height < tgState->height ? height : tgState->height;
+    uint64_t pixelBytes = cmd->op == BLIT_EXPAND ? BLIT_EXPAND_PIXEL_BYTES : tgState->bytesPerPixel;
+    return BLIT_COMMAND_BYTES + width * height * pixelBytes;
+}
+
+//Runs the blit list at guest address list, returns what the blitter's register reads afterwards. Blits write the
+//framebuffer like the guest would, drawFramebuffer puts them on screen at the end of the step.
+static uint32_t runBlitList( KARVContext *ctx, uint32_t list )
+{
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    BlitTarget target;
+    target.pixels = ctx->ram_image + framebufferPage(ctx, ctx->blitPage);
+    target.width = tgState->width;
+    target.height = tgState->height;
+    target.bytesPerPixel = tgState->bytesPerPixel;
+    target.memory = ctx->ram_image;
+    target.memorySize = MINI_RV32_RAM_SIZE;
+    target.memoryBase = MINIRV32_RAM_IMAGE_OFFSET;
+    uint32_t count = 0;
+    for (; count < BLIT_MAX_COMMANDS; count++) {
+        BlitCommand cmd;
+        if (!BlitInMemory(&target, list, (uint64_t)count * sizeof(cmd), sizeof(cmd))) {
+            return count | BLIT_STATUS_BAD;
+        }
+        memcpy(&cmd, ctx->ram_image + (list - MINIRV32_RAM_IMAGE_OFFSET) + count * sizeof(cmd), sizeof(cmd));
+        if (cmd.op == BLIT_END) {
+            break;
+        }
+        if (ctx->blitBytesLeft == 0) {
+            return count | BLIT_STATUS_BUSY;
+        }
+        uint64_t cost = blitCost(tgState, &cmd);
+        ctx->blitBytesLeft -= cost < ctx->blitBytesLeft ? cost : ctx->blitBytesLeft;
+        uint32_t ofs;
+        uint32_t len;
+        if (!BlitRun(&target, &cmd, &ofs, &len)) {
+            return count | BLIT_STATUS_BAD;
+        }
+        hostWroteRam(ctx, framebufferPage(ctx, ctx->blitPage) + ofs, len);
+    }
+    return count;
+}
+
+//Shows page from the end of this step on. Its pixels only get drawn where they differ from what's on screen, so
+//flipping between whole frames costs about what drawing the difference into one page would.
+static void flipPage( KARVContext *ctx, uint32_t page )
+{
+    TermGraphicsState *tgState = &ctx->termGraphicsState;
+    if (page >= numFramebufferPages(tgState) || page == ctx->shownPage) {
+        return;
+    }
+    ctx->shownPage = page;
+    uint32_t first = framebufferPage(ctx, page) / SNAPSHOT_PAGE_SIZE;
+    for (uint32_t i=0; i<framebufferPageStride(tgState) / SNAPSHOT_PAGE_SIZE; i++) {
+        ctx->dirtyPages[first + i] |= DIRTY_FRAMEBUFFER;
+    }
+}
+
+static uint32_t HandleControlStore( KARVContext *ctx, uint32_t addy, uint32_t val )
 {
 	if( addy == 0x10000000 ) //UART 8250 / 16550 Data Buffer
 	{
-		fprintf(logFile, "%c", val);
-        fflush(logFile);
-        writeChar(&termGraphicsState, val);
+        if (ctx->logFile != NULL) {
+            fprintf(ctx->logFile, "%c", val);
+            fflush(ctx->logFile);
+        }
+        writeChar(&ctx->termGraphicsState, val);
 		//printf("%c", val);
         //fflush(stdout);
-	} else if (addy == 0x11000000) { //Graphics width
-        fprintf(stderr, "Guest tried to set width to %u, but guest-set sizes are not supported yet\n", val);
+	} else if (addy == 0x11000000) { //Graphics width, staged until the mode is applied
+        ctx->stagedMode.width = val;
     } else if (addy == 0x11000004) { //Graphics height
-        fprintf(stderr, "Guest tried to set height to %u, but guest-set sizes are not supported yet\n", val);
-    } else if (addy >= 0x1100000C && addy < termGraphicsState.width*termGraphicsState.height*4+0x1100000C) { //Graphics frame buffer
-        uint32_t index = addy-0x1100000C;
-        uint8_t r = (val >>  0) & 0xFF;
-        uint8_t g = (val >>  8) & 0xFF;
-        uint8_t b = (val >> 16) & 0xFF;
-        uint8_t a = (val >> 24) & 0xFF;
-        
-        termGraphicsState.vram[index+0] = r;
-        termGraphicsState.vram[index+1] = g;
-        termGraphicsState.vram[index+2] = b;
-        termGraphicsState.vram[index+3] = a;
+        ctx->stagedMode.height = val;
+    } else if (addy == 0x11800000) { //Graphics format
+        ctx->stagedMode.format = val;
+    } else if (addy == 0x11800008) { //Apply the staged mode
+        applyStagedMode(ctx);
+    } else if (addy >= 0x11800400 && addy < 0x11800400 + PALETTE_SIZE*4) { //Palette
+        ctx->palette[(addy - 0x11800400) / 4] = val;
+        ctx->paletteChanged = true;
+    } else if (addy >= 0x1100000C && addy < termPixelsSize(&ctx->termGraphicsState)+0x1100000C) { //Graphics frame buffer
+        //The old window onto the framebuffer, slow but the same as storing to it after RAM
+        uint32_t ofs = FRAMEBUFFER_OFFSET + (addy - 0x1100000C);
+        memcpy(ctx->ram_image + ofs, &val, 4);
+        hostWroteRam(ctx, ofs, 4);
+    } else if (addy == 0x11800014) { //Flip
+        flipPage(ctx, val);
+    } else if (addy == 0x11900000) { //Run a blit list
+        ctx->blitStatus = runBlitList(ctx, val);
+    } else if (addy == 0x11900004) { //The page blits draw into
+        if (val < numFramebufferPages(&ctx->termGraphicsState)) {
+            ctx->blitPage = val;
+        }
     }
 	return 0;
 }
 
-static uint32_t HandleControlLoad( uint32_t addy )
+static uint32_t HandleControlLoad( KARVContext *ctx, uint32_t addy )
 {
 	// Emulating a 8250 / 16550 UART
 	if( addy == 0x10000005 ) {
-		return 0x60 | IsKBHit();
-    } else if( addy == 0x10000000 && IsKBHit() ) {
-		return ReadKBByte();
+		return 0x60 | IsKBHit( ctx );
+    } else if( addy == 0x10000000 && IsKBHit( ctx ) ) {
+		return ReadKBByte( ctx );
     } else if (addy == 0x11000000) { //Graphics width
-        return termGraphicsState.width;
+        return ctx->termGraphicsState.width;
     } else if (addy == 0x11000004) { //Graphics height
-        return termGraphicsState.height;
-    } else if (addy == 0x11000008) { //Reserved for other graphics data
-        return 0;
-    } else if (addy >= 0x1100000C && addy < termGraphicsState.width*termGraphicsState.height*4+0x1100000C) { //Graphics frame buffer
-        uint32_t index = addy-0x1100000C;
-        uint32_t r = termGraphicsState.vram[index];
-        uint32_t g = termGraphicsState.vram[index+1];
-        uint32_t b = termGraphicsState.vram[index+2];
-        uint32_t a = termGraphicsState.vram[index+3];
-        uint32_t result = r | g << 8 | b << 16 | a << 24;
-        //uint32_t altResult = ((uint32_t*)localVram)[index/4];
-        //fprintf(stderr, "result: %x, altResult: %x\n", result, altResult);
+        return ctx->termGraphicsState.height;
+    } else if (addy == 0x11000008) { //Where the framebuffer is
+        return MINIRV32_RAM_IMAGE_OFFSET + FRAMEBUFFER_OFFSET;
+    } else if (addy == 0x11800000) { //Graphics format
+        return ctx->screenFormat;
+    } else if (addy == 0x11800004) { //Bytes per row of the framebuffer
+        return ctx->termGraphicsState.width * ctx->termGraphicsState.bytesPerPixel;
+    } else if (addy == 0x11800008) { //Whether the last mode applied was taken
+        return ctx->modeTaken;
+    } else if (addy == 0x1180000C) { //Bytes from one framebuffer page to the next
+        return framebufferPageStride(&ctx->termGraphicsState);
+    } else if (addy == 0x11800010) { //Framebuffer pages
+        return numFramebufferPages(&ctx->termGraphicsState);
+    } else if (addy == 0x11800014) { //The page being shown
+        return ctx->shownPage;
+    } else if (addy == 0x11800018) { //Frames presented
+        return ctx->framesPresented;
+    } else if (addy == 0x11900000) { //What the last blit list did
+        return ctx->blitStatus;
+    } else if (addy == 0x11900004) { //The page blits draw into
+        return ctx->blitPage;
+    } else if (addy >= 0x11800400 && addy < 0x11800400 + PALETTE_SIZE*4) { //Palette
+        return ctx->palette[(addy - 0x11800400) / 4];
+    } else if (addy >= 0x1100000C && addy < termPixelsSize(&ctx->termGraphicsState)+0x1100000C) { //Graphics frame buffer
+        uint32_t result;
+        memcpy(&result, ctx->ram_image + FRAMEBUFFER_OFFSET + (addy - 0x1100000C), 4);
         return result;
     }
     
 	return 0;
 }
 
-static void HandleOtherCSRWrite( uint8_t * image, uint16_t csrno, uint32_t value )
+static void HandleOtherCSRWrite( KARVContext *ctx, uint8_t * image, uint16_t csrno, uint32_t value )
 {
 	if( csrno == 0x136 )
 	{
-        VRAMnPrintf(&termGraphicsState, 16, "%d", value); //32 bit number in decimal can't have more than 10 digits
-		fprintf( logFile, "%d", value );
-        fflush(logFile);
+        VRAMnPrintf(&ctx->termGraphicsState, 16, "%d", value); //32 bit number in decimal can't have more than 10 digits
+        if (ctx->logFile != NULL) {
+            fprintf( ctx->logFile, "%d", value );
+            fflush(ctx->logFile);
+        }
 		//printf( "%d", value ); fflush( stdout );
 	}
 	if( csrno == 0x137 )
 	{
-        VRAMnPrintf(&termGraphicsState, 16, "%08x", value); //32 bit number in decimal can't have more than 8 digits
-        fprintf( logFile, "%08x", value );
-        fflush(logFile);
+        VRAMnPrintf(&ctx->termGraphicsState, 16, "%08x", value); //32 bit number in decimal can't have more than 8 digits
+        if (ctx->logFile != NULL) {
+            fprintf( ctx->logFile, "%08x", value );
+            fflush(ctx->logFile);
+        }
 		//printf( "%08x", value ); fflush( stdout );
 	}
 	else if( csrno == 0x138 )
@@ -465,8 +2133,10 @@ static void HandleOtherCSRWrite( uint8_t * image, uint16_t csrno, uint32_t value
 		uint32_t ptrstart = value - MINIRV32_RAM_IMAGE_OFFSET;
 		uint32_t ptrend = ptrstart;
 		if( ptrstart >= MINI_RV32_RAM_SIZE ) {
-			fprintf( logFile, "DEBUG PASSED INVALID PTR (%08x)\n", value );
-        fflush(logFile);
+            if (ctx->logFile != NULL) {
+                fprintf( ctx->logFile, "DEBUG PASSED INVALID PTR (%08x)\n", value );
+                fflush(ctx->logFile);
+            }
 			printf( "DEBUG PASSED INVALID PTR (%08x)\n", value );
         }
 		while( ptrend < MINI_RV32_RAM_SIZE )
@@ -475,27 +2145,31 @@ static void HandleOtherCSRWrite( uint8_t * image, uint16_t csrno, uint32_t value
 			ptrend++;
 		}
 		if( ptrend != ptrstart ) {
-            writeArray(&termGraphicsState, (char *)image + ptrstart, ptrend - ptrstart);
-            fwrite( image + ptrstart, ptrend - ptrstart, 1, logFile );
-            fflush(logFile);
+            writeArray(&ctx->termGraphicsState, (char *)image + ptrstart, ptrend - ptrstart);
+            if (ctx->logFile != NULL) {
+                fwrite( image + ptrstart, ptrend - ptrstart, 1, ctx->logFile );
+                fflush(ctx->logFile);
+            }
 			//fwrite( image + ptrstart, ptrend - ptrstart, 1, stdout );
         }
 	}
 	else if( csrno == 0x139 )
 	{
-        writeChar(&termGraphicsState, value);
-        fputc(value, logFile);
-        fflush(logFile);
+        writeChar(&ctx->termGraphicsState, value);
+        if (ctx->logFile != NULL) {
+            fputc(value, ctx->logFile);
+            fflush(ctx->logFile);
+        }
 		//putchar( value ); fflush( stdout );
 	}
 }
 
-static int32_t HandleOtherCSRRead( uint8_t * image, uint16_t csrno )
+static int32_t HandleOtherCSRRead( KARVContext *ctx, uint8_t * image, uint16_t csrno )
 {
 	if( csrno == 0x140 )
 	{
-		if( !IsKBHit() ) return -1;
-		return ReadKBByte();
+		if( !IsKBHit( ctx ) ) return -1;
+		return ReadKBByte( ctx );
 	}
 	return 0;
 }
@@ -0,0 +1,431 @@
+/*-------------------------------------------------------------------------------*\
+ | snapshot.h Copyright (c) 2025 StrandedSoftwareDeveloper under the MIT License |
+ | Snapshot file format, responsibilities include:                               |
+ |  - Writing and checking the header that ties a snapshot to its machine        |
+ |  - Storing guest RAM as a list of its non-zero pages, each one compressed     |
+ |  - Deltas, which only hold the pages written since the snapshot they extend   |
+ |  - A small LZ77 codec for those pages                                         |
+ |  - Indexing a mapped snapshot so its pages can be unpacked one at a time      |
+ |  - Hashing whatever the key of a snapshot is made from                        |
+ |                                                                               |
+ | A snapshot is a SnapshotHeader followed by tagged sections and ends with a    |
+ | SNAPSHOT_SECTION_END section, so a file cut short is never mistaken for a     |
+ | whole one. Everything is stored in host byte order.                           |
+\*-------------------------------------------------------------------------------*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SNAPSHOT_MAGIC "KARVSNAP"
+#define SNAPSHOT_VERSION 8
+#define SNAPSHOT_PAGE_SIZE 4096
+#define SNAPSHOT_HASH_SEED 0xcbf29ce484222325ull
+
+typedef enum {
+    SNAPSHOT_SECTION_END,
+    SNAPSHOT_SECTION_RAM,      //{uint32_t page; uint16_t size; uint8_t data[size];} for every non-zero page, see SnapshotWriteRAM
+    SNAPSHOT_SECTION_TERMINAL, //Owned by whoever writes the snapshot
+} SnapshotSectionTag;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t pageSize;
+    uint64_t key; //Whatever the writer needs a snapshot to match before it may be loaded
+    uint32_t ramSize;
+    uint32_t reserved;
+    uint64_t id;     //Picked by the writer, so deltas can name the snapshot they go on top of
+    uint64_t baseId; //0 for a whole snapshot, otherwise this is a delta and only has what changed since baseId
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t size; //Of the data following this
+} SnapshotSection;
+
+//FNV-1a over 8 byte words with an extra shift to mix the high bits down, fast enough to run over a kernel on every boot
+static uint64_t SnapshotHash(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool SnapshotWriteHeader(FILE *f, uint64_t key, uint32_t ramSize, uint64_t id, uint64_t baseId) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+    header.version = SNAPSHOT_VERSION;
+    header.pageSize = SNAPSHOT_PAGE_SIZE;
+    header.key = key;
+    header.ramSize = ramSize;
+    header.id = id;
+    header.baseId = baseId;
+    return fwrite(&header, sizeof(header), 1, f) == 1;
+}
+
+static bool SnapshotCheckHeader(const SnapshotHeader *header, uint64_t key, uint32_t ramSize) {
+    return memcmp(header->magic, SNAPSHOT_MAGIC, 8) == 0 && header->version == SNAPSHOT_VERSION &&
+           header->pageSize == SNAPSHOT_PAGE_SIZE && header->key == key && header->ramSize == ramSize;
+}
+
+//False if f isn't a snapshot, or is one for a different key or RAM size. Leaves the header in *header either way.
+static bool SnapshotReadHeader(FILE *f, uint64_t key, uint32_t ramSize, SnapshotHeader *header) {
+    if (fread(header, sizeof(*header), 1, f) != 1) {
+        return false;
+    }
+    return SnapshotCheckHeader(header, key, ramSize);
+}
+
+//For sections whose data gets written in several pieces, the caller writes exactly size bytes after this
+static bool SnapshotBeginSection(FILE *f, uint32_t tag, uint64_t size) {
+    SnapshotSection section;
+    section.tag = tag;
+    section.reserved = 0;
+    section.size = size;
+    return fwrite(&section, sizeof(section), 1, f) == 1;
+}
+
+static bool SnapshotWriteSection(FILE *f, uint32_t tag, const void *data, uint64_t size) {
+    return SnapshotBeginSection(f, tag, size) && (size == 0 || fwrite(data, size, 1, f) == 1);
+}
+
+static bool SnapshotReadSection(FILE *f, SnapshotSection *section) {
+    return fread(section, sizeof(*section), 1, f) == 1;
+}
+
+//The codec is LZ4-like: a run of sequences, each one a token byte (high nibble the literal count, low nibble
+//the match length minus SNAPSHOT_LZ_MIN_MATCH, 15 in either meaning more length bytes follow, each adding up
+//to 255), the literals, then a 2 byte offset back to the match. The last sequence is only literals.
+#define SNAPSHOT_LZ_MIN_MATCH 4
+#define SNAPSHOT_LZ_HASH_BITS 12
+
+static uint32_t SnapshotRead32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+//Writes a length that didn't fit in its nibble, returns the new end of dst or NULL if it ran out of room
+static uint8_t *SnapshotLZPutLength(uint8_t *op, uint8_t *opEnd, uint32_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= opEnd) {
+            return NULL;
+        }
+        *op++ = 255;
+    }
+    if (op >= opEnd) {
+        return NULL;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+//Writes one sequence, matchLen 0 for the final literals-only one
+static uint8_t *SnapshotLZPutSequence(uint8_t *op, uint8_t *opEnd, const uint8_t *literals, uint32_t numLiterals, uint32_t offset, uint32_t matchLen) {
+    if (op >= opEnd) {
+        return NULL;
+    }
+    uint8_t *token = op++;
+    *token = (uint8_t)((numLiterals < 15 ? numLiterals : 15) << 4);
+    if (numLiterals >= 15 && (op = SnapshotLZPutLength(op, opEnd, numLiterals - 15)) == NULL) {
+        return NULL;
+    }
+    if ((uint32_t)(opEnd - op) < numLiterals) {
+        return NULL;
+    }
+    memcpy(op, literals, numLiterals);
+    op += numLiterals;
+    if (matchLen == 0) {
+        return op;
+    }
+
+    if (opEnd - op < 2) {
+        return NULL;
+    }
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    uint32_t len = matchLen - SNAPSHOT_LZ_MIN_MATCH;
+    *token |= len < 15 ? len : 15;
+    if (len >= 15 && (op = SnapshotLZPutLength(op, opEnd, len - 15)) == NULL) {
+        return NULL;
+    }
+    return op;
+}
+
+//Compresses srcLen (at most 64KB) bytes into dst, which has room for srcLen bytes. Returns the compressed size,
+//or 0 if it wouldn't come out any smaller, in which case the data is better off stored as it is.
+static uint32_t SnapshotCompress(const uint8_t *src, uint32_t srcLen, uint8_t *dst) {
+    uint16_t table[1 << SNAPSHOT_LZ_HASH_BITS]; //Position + 1 of the last time a 4 byte sequence was seen
+    memset(table, 0, sizeof(table));
+    uint8_t *op = dst;
+    uint8_t *opEnd = dst + srcLen - 1; //Has to beat srcLen, not just match it
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+    uint32_t misses = 0;
+    while (ip + SNAPSHOT_LZ_MIN_MATCH <= srcLen) {
+        uint32_t seq = SnapshotRead32(src + ip);
+        uint32_t hash = (seq * 2654435761u) >> (32 - SNAPSHOT_LZ_HASH_BITS);
+        uint32_t ref = table[hash];
+        table[hash] = (uint16_t)(ip + 1);
+        if (ref == 0 || SnapshotRead32(src + ref - 1) != seq) {
+            //Take bigger steps the longer nothing matches, so incompressible data goes by quickly
+            ip += 1 + (misses++ >> 5);
+            continue;
+        }
+        misses = 0;
+        ref--;
+        uint32_t matchLen = SNAPSHOT_LZ_MIN_MATCH;
+        while (ip + matchLen + 8 <= srcLen) {
+            uint64_t a, b;
+            memcpy(&a, src + ref + matchLen, 8);
+            memcpy(&b, src + ip + matchLen, 8);
+            if (a != b) {
+                break;
+            }
+            matchLen += 8;
+        }
+        //The rest of it byte by byte, at most 8 of them
+        while (ip + matchLen < srcLen && src[ref + matchLen] == src[ip + matchLen]) {
+            matchLen++;
+        }
+        op = SnapshotLZPutSequence(op, opEnd, src + anchor, ip - anchor, ip - ref, matchLen);
+        if (op == NULL) {
+            return 0;
+        }
+        ip += matchLen;
+        anchor = ip;
+    }
+    op = SnapshotLZPutSequence(op, opEnd, src + anchor, srcLen - anchor, 0, 0);
+    return op != NULL ? (uint32_t)(op - dst) : 0;
+}
+
+//Reads a length continued past its nibble, false if src ran out first
+static bool SnapshotLZGetLength(const uint8_t **ip, const uint8_t *ipEnd, uint32_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= ipEnd) {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+//False unless src decompresses to exactly dstLen bytes, never reads or writes out of bounds on bad input
+static bool SnapshotDecompress(const uint8_t *src, uint32_t srcLen, uint8_t *dst, uint32_t dstLen) {
+    const uint8_t *ip = src;
+    const uint8_t *ipEnd = src + srcLen;
+    uint32_t op = 0;
+    while (ip < ipEnd) {
+        uint8_t token = *ip++;
+        uint32_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !SnapshotLZGetLength(&ip, ipEnd, &numLiterals)) {
+            return false;
+        }
+        if ((uint32_t)(ipEnd - ip) < numLiterals || dstLen - op < numLiterals) {
+            return false;
+        }
+        memcpy(dst + op, ip, numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+        if (ip == ipEnd) {
+            break; //The last sequence has no match
+        }
+
+        if (ipEnd - ip < 2) {
+            return false;
+        }
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        uint32_t matchLen = token & 15;
+        if (matchLen == 15 && !SnapshotLZGetLength(&ip, ipEnd, &matchLen)) {
+            return false;
+        }
+        matchLen += SNAPSHOT_LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || dstLen - op < matchLen) {
+            return false;
+        }
+        if (offset >= matchLen) {
+            memcpy(dst + op, dst + op - offset, matchLen);
+            op += matchLen;
+        } else {
+            //Byte by byte, the match overlaps what it's writing
+            for (uint32_t i=0; i<matchLen; i++, op++) {
+                dst[op] = dst[op - offset];
+            }
+        }
+    }
+    return op == dstLen;
+}
+
+static bool SnapshotIsZeroPage(const uint8_t *page) {
+    const uint64_t *words = (const uint64_t *)page;
+    for (int i=0; i<SNAPSHOT_PAGE_SIZE/8; i++) {
+        if (words[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Zero pages are left out, they come back as zero anyway as long as the RAM is cleared before loading.
+//Every other page is compressed on its own, a size of SNAPSHOT_PAGE_SIZE means it's stored as it is.
+//For a delta, pages has a byte per page and only the ones with a bit of pageMask set are written, zero or not.
+static bool SnapshotWriteRAM(FILE *f, const uint8_t *ram, uint32_t ramSize, const uint8_t *pages, uint8_t pageMask) {
+    long start = ftell(f);
+    if (start < 0 || !SnapshotBeginSection(f, SNAPSHOT_SECTION_RAM, 0)) {
+        return false;
+    }
+    uint64_t size = 0;
+    uint8_t compressed[SNAPSHOT_PAGE_SIZE];
+    for (uint32_t page=0; page<ramSize/SNAPSHOT_PAGE_SIZE; page++) {
+        const uint8_t *data = ram + (size_t)page * SNAPSHOT_PAGE_SIZE;
+        if (pages != NULL ? !(pages[page] & pageMask) : SnapshotIsZeroPage(data)) {
+            continue;
+        }
+        uint16_t pageSize = (uint16_t)SnapshotCompress(data, SNAPSHOT_PAGE_SIZE, compressed);
+        if (pageSize == 0) {
+            pageSize = SNAPSHOT_PAGE_SIZE;
+        }
+        if (fwrite(&page, sizeof(page), 1, f) != 1 || fwrite(&pageSize, sizeof(pageSize), 1, f) != 1 ||
+            fwrite(pageSize == SNAPSHOT_PAGE_SIZE ? data : compressed, pageSize, 1, f) != 1) {
+            return false;
+        }
+        size += sizeof(page) + sizeof(pageSize) + pageSize;
+    }
+
+    //Go back and fill in the size now that it's known
+    long end = ftell(f);
+    return end >= 0 && fseek(f, start, SEEK_SET) == 0 && SnapshotBeginSection(f, SNAPSHOT_SECTION_RAM, size) &&
+           fseek(f, end, SEEK_SET) == 0;
+}
+
+//Reads the data of a SNAPSHOT_SECTION_RAM into ram, which has to be zeroed already unless it's a delta going on
+//top of its base. If pages isn't NULL every page read gets pageMask set in its byte there.
+static bool SnapshotReadRAM(FILE *f, const SnapshotSection *section, uint8_t *ram, uint32_t ramSize, uint8_t *pages, uint8_t pageMask) {
+    uint8_t compressed[SNAPSHOT_PAGE_SIZE];
+    uint64_t left = section->size;
+    while (left > 0) {
+        uint32_t page;
+        uint16_t pageSize;
+        if (left < sizeof(page) + sizeof(pageSize) || fread(&page, sizeof(page), 1, f) != 1 ||
+            fread(&pageSize, sizeof(pageSize), 1, f) != 1) {
+            return false;
+        }
+        left -= sizeof(page) + sizeof(pageSize);
+        if (page >= ramSize/SNAPSHOT_PAGE_SIZE || pageSize == 0 || pageSize > SNAPSHOT_PAGE_SIZE || left < pageSize) {
+            return false;
+        }
+        left -= pageSize;
+        if (pages != NULL) {
+            pages[page] |= pageMask;
+        }
+
+        //Never read straight into ram, it might be lazy RAM that only fills when the host touches it
+        uint8_t *data = ram + (size_t)page * SNAPSHOT_PAGE_SIZE;
+        if (fread(compressed, pageSize, 1, f) != 1) {
+            return false;
+        }
+        if (pageSize == SNAPSHOT_PAGE_SIZE) {
+            memcpy(data, compressed, SNAPSHOT_PAGE_SIZE);
+        } else if (!SnapshotDecompress(compressed, pageSize, data, SNAPSHOT_PAGE_SIZE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Same as SnapshotReadRAM, but for a snapshot in memory (see SnapshotMapFile) and without decompressing anything:
+//records where each page's record starts in pageRecord (a uint32_t per page of RAM, 0 for pages not in the
+//snapshot) for SnapshotLoadPage. section is the offset of the section's data in file.
+static bool SnapshotIndexRAM(const uint8_t *file, uint64_t section, uint64_t size, uint32_t ramSize, uint32_t *pageRecord) {
+    uint64_t ofs = section;
+    uint64_t end = section + size;
+    while (ofs < end) {
+        uint32_t page;
+        uint16_t pageSize;
+        if (end - ofs < sizeof(page) + sizeof(pageSize)) {
+            return false;
+        }
+        memcpy(&page, file + ofs, sizeof(page));
+        memcpy(&pageSize, file + ofs + sizeof(page), sizeof(pageSize));
+        if (page >= ramSize/SNAPSHOT_PAGE_SIZE || pageSize == 0 || pageSize > SNAPSHOT_PAGE_SIZE ||
+            end - ofs - sizeof(page) - sizeof(pageSize) < pageSize || ofs > UINT32_MAX) {
+            return false;
+        }
+        pageRecord[page] = (uint32_t)ofs;
+        ofs += sizeof(page) + sizeof(pageSize) + pageSize;
+    }
+    return true;
+}
+
+//Unpacks the page whose record SnapshotIndexRAM found at record into dst. Safe to call from a signal handler.
+static bool SnapshotLoadPage(const uint8_t *record, uint8_t *dst) {
+    uint16_t pageSize;
+    memcpy(&pageSize, record + sizeof(uint32_t), sizeof(pageSize));
+    const uint8_t *data = record + sizeof(uint32_t) + sizeof(pageSize);
+    if (pageSize == SNAPSHOT_PAGE_SIZE) {
+        memcpy(dst, data, SNAPSHOT_PAGE_SIZE);
+        return true;
+    }
+    return SnapshotDecompress(data, pageSize, dst, SNAPSHOT_PAGE_SIZE);
+}
+
+//Maps a whole snapshot file read only, NULL if that fails or isn't supported here. The mapping stays valid after
+//the file gets replaced, writers rename a new file over the old one rather than writing into it.
+static const uint8_t *SnapshotMapFile(const char *path, size_t *size) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *size = st.st_size;
+    return data;
+#else
+    (void)path; (void)size;
+    return NULL;
+#endif
+}
+
+static void SnapshotUnmapFile(const uint8_t *data, size_t size) {
+#ifndef _WIN32
+    if (data != NULL) {
+        munmap((void *)data, size);
+    }
+#else
+    (void)data; (void)size;
+#endif
+}
+
+#endif
@@ -2,150 +2,424 @@
  | terminal.c Copyright (c) 2025 StrandedSoftwareDeveloper under the MIT License |
  | Responsibilities include:                                                     |
  | - VT100-ish terminal emulator                                                 |
- | - Bitmap font renderer                                                        |
+ | - Keeping the screen as a grid of character cells                             |
+ | - Bitmap font renderer, drawing only the cells that changed                   |
 \*------------------------------------------------------------------------------*/
 
 #include "terminal.h"
+#include "font437.h"
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-void clearScreen(TermGraphicsState *tgState) {
+static inline void putPixel(uint8_t *pixel, int bytesPerPixel, uint32_t val) {
+    switch (bytesPerPixel) {
+        case 1: *pixel = val; break;
+        case 2: *(uint16_t *)pixel = val; break;
+        default: *(uint32_t *)pixel = val; break;
+    }
+}
+
+static void clearPixels(TermGraphicsState *tgState) {
+    int bytesPerPixel = tgState->bytesPerPixel;
     for (int i=0; i<tgState->width*tgState->height; i++) {
-        tgState->vram[i*4+0] = 0;
-        tgState->vram[i*4+1] = 0;
-        tgState->vram[i*4+2] = 0;
-        tgState->vram[i*4+3] = 255;
+        putPixel(&tgState->vram[i*bytesPerPixel], bytesPerPixel, tgState->paper);
+    }
+}
+
+//Needs vram, width, height, the pixel format, charWidth and charHeight set, leaves the screen blank
+bool initTerminal(TermGraphicsState *tgState) {
+    tgState->cols = tgState->width / tgState->charWidth;
+    tgState->rows = tgState->height / tgState->charHeight;
+    tgState->rowMap = malloc(terminalTextSize(tgState));
+    if (tgState->rowMap == NULL) {
+        return false;
+    }
+    tgState->cells = (TermCell *)(tgState->rowMap + tgState->rows);
+    tgState->numBands = (tgState->height + tgState->charHeight - 1) / tgState->charHeight;
+    tgState->damage = malloc(tgState->numBands * sizeof(TermSpan));
+    if (tgState->damage == NULL) {
+        freeTerminal(tgState);
+        return false;
+    }
+    for (int band=0; band<tgState->numBands; band++) {
+        tgState->damage[band] = (TermSpan){ UINT16_MAX, 0 };
+    }
+    tgState->drawnCursorCol = 0;
+    tgState->drawnCursorRow = 0;
+    resetScrollRegion(tgState);
+    clearScreen(tgState);
+    return true;
+}
+
+void freeTerminal(TermGraphicsState *tgState) {
+    free(tgState->rowMap);
+    free(tgState->damage);
+    tgState->rowMap = NULL;
+    tgState->cells = NULL;
+    tgState->damage = NULL;
+}
+
+//The row map and the cells, which are one allocation starting at rowMap
+size_t terminalTextSize(const TermGraphicsState *tgState) {
+    return tgState->rows * (sizeof(uint16_t) + tgState->cols * sizeof(TermCell));
+}
+
+//The grey lit pixels of text are, for working out ink in whatever format vram is in (paper is black)
+uint8_t terminalInkGrey(void) {
+    return FONT437_INK;
+}
+
+void resetScrollRegion(TermGraphicsState *tgState) {
+    tgState->scrollTop = 0;
+    tgState->scrollBottom = tgState->rows - 1;
+}
+
+static void damageBands(TermGraphicsState *tgState, int firstBand, int endBand, int left, int right) {
+    for (int band=firstBand; band<endBand; band++) {
+        TermSpan *span = &tgState->damage[band];
+        if (left < span->left) {
+            span->left = left;
+        }
+        if (right > span->right) {
+            span->right = right;
+        }
+    }
+}
+
+//Cells [firstCol, endCol) of a row on screen
+static void damageCells(TermGraphicsState *tgState, int row, int firstCol, int endCol) {
+    if (row < tgState->rows) {
+        damageBands(tgState, row, row + 1, firstCol * tgState->charWidth, endCol * tgState->charWidth);
+    }
+}
+
+//Pixels of the screen that were changed from outside the terminal, clipped to it
+void damageRect(TermGraphicsState *tgState, int x, int y, int width, int height) {
+    int right = x + width < tgState->width ? x + width : tgState->width;
+    int bottom = y + height < tgState->height ? y + height : tgState->height;
+    x = x > 0 ? x : 0;
+    y = y > 0 ? y : 0;
+    if (x >= right || y >= bottom) {
+        return;
+    }
+    damageBands(tgState, y / tgState->charHeight, (bottom - 1) / tgState->charHeight + 1, x, right);
+}
+
+//Bytes [ofs, ofs + len) of the screen as the guest sees it, a whole row wide once they wrap onto the next one
+void damageBytes(TermGraphicsState *tgState, uint32_t ofs, uint32_t len) {
+    if (len == 0) {
+        return;
+    }
+    uint32_t first = ofs / tgState->bytesPerPixel;
+    uint32_t last = (ofs + len - 1) / tgState->bytesPerPixel;
+    int y = first / tgState->width;
+    int lastY = last / tgState->width;
+    if (y == lastY) {
+        damageRect(tgState, first % tgState->width, y, last - first + 1, 1);
+    } else {
+        damageRect(tgState, 0, y, tgState->width, lastY - y + 1);
+    }
+}
+
+//Fills rects with what changed on screen since the last call, merging bands that line up, and starts over. Returns
+//how many it filled, or 1 with everything that changed in one rect if it would've taken more than max (>= 1).
+int takeDamage(TermGraphicsState *tgState, TermRect *rects, int max) {
+    int count = 0;
+    bool overflow = false;
+    TermRect bounds = { tgState->width, tgState->height, 0, 0 }; //Right and bottom edges until the end
+    for (int band=0; band<tgState->numBands; band++) {
+        TermSpan *span = &tgState->damage[band];
+        if (span->left >= span->right) {
+            continue;
+        }
+        uint16_t y = band * tgState->charHeight;
+        uint16_t height = y + tgState->charHeight <= tgState->height ? tgState->charHeight : tgState->height - y;
+        TermRect *last = count > 0 ? &rects[count - 1] : NULL;
+        if (last != NULL && last->x == span->left && last->width == span->right - span->left &&
+            last->y + last->height == y) {
+            last->height += height;
+        } else if (count < max) {
+            rects[count++] = (TermRect){ span->left, y, span->right - span->left, height };
+        } else {
+            overflow = true;
+        }
+        bounds.x = span->left < bounds.x ? span->left : bounds.x;
+        bounds.y = y < bounds.y ? y : bounds.y;
+        bounds.width = span->right > bounds.width ? span->right : bounds.width;
+        bounds.height = y + height;
+        *span = (TermSpan){ UINT16_MAX, 0 };
+    }
+    if (overflow) {
+        bounds.width -= bounds.x;
+        bounds.height -= bounds.y;
+        rects[0] = bounds;
+        return 1;
+    }
+    return count;
+}
+
+//NULL if (col, row) is off screen, which the cursor can be after moving too far
+static TermCell *cellAt(TermGraphicsState *tgState, int col, int row) {
+    if (col < 0 || col >= tgState->cols || row < 0 || row >= tgState->rows) {
+        return NULL;
+    }
+    return &tgState->cells[tgState->rowMap[row] * tgState->cols + col];
+}
+
+static void setCell(TermGraphicsState *tgState, int col, int row, uint8_t c) {
+    TermCell *cell = cellAt(tgState, col, row);
+    if (cell != NULL) {
+        cell->c = c;
+        cell->attr = TERM_CELL_DIRTY;
+        tgState->dirty = true;
+        damageCells(tgState, row, col, col + 1);
     }
 }
 
+//Blanks the cells in [firstCol, endCol) of a row on screen
+static void clearCells(TermGraphicsState *tgState, int row, int firstCol, int endCol) {
+    if (row >= tgState->rows || firstCol >= endCol) {
+        return;
+    }
+    TermCell *cells = &tgState->cells[tgState->rowMap[row] * tgState->cols];
+    for (int col=firstCol; col<endCol; col++) {
+        cells[col].c = ' ';
+        cells[col].attr = TERM_CELL_DIRTY;
+    }
+    tgState->dirty = true;
+    damageCells(tgState, row, firstCol, endCol);
+}
+
+static void clearRows(TermGraphicsState *tgState, int firstRow, int endRow) {
+    for (int row=firstRow; row<endRow; row++) {
+        clearCells(tgState, row, 0, tgState->cols);
+    }
+}
+
+static int cursorCol(TermGraphicsState *tgState) {
+    return tgState->cursorX / tgState->charWidth;
+}
+
+static int cursorRow(TermGraphicsState *tgState) {
+    return tgState->cursorY / tgState->charHeight;
+}
+
+void clearScreen(TermGraphicsState *tgState) {
+    //Blank cells look just like cleared pixels, so there's nothing left to draw
+    for (int row=0; row<tgState->rows; row++) {
+        tgState->rowMap[row] = row;
+    }
+    for (int i=0; i<tgState->cols*tgState->rows; i++) {
+        tgState->cells[i].c = ' ';
+        tgState->cells[i].attr = 0;
+    }
+    clearPixels(tgState);
+    tgState->drawnCursorShown = false;
+    damageRect(tgState, 0, 0, tgState->width, tgState->height);
+}
+
 void drawChar(TermGraphicsState *tgState, uint16_t x, uint16_t y, uint8_t c) {
-    const int charOffsetX = (c % (tgState->fontWidth / tgState->charWidth)) * tgState->charWidth;
-    const int charOffsetY = (c / (tgState->fontWidth / tgState->charWidth)) * tgState->charHeight;
-    for (int yOffset=0; yOffset<tgState->charHeight; yOffset++) {
-        for (int xOffset=0; xOffset<tgState->charWidth; xOffset++) {
-            uint8_t val = tgState->font[(yOffset+charOffsetY)*tgState->fontWidth+(xOffset+charOffsetX)];
-            tgState->vram[((y+yOffset)*tgState->width+(x+xOffset))*4+0] = val;
-            tgState->vram[((y+yOffset)*tgState->width+(x+xOffset))*4+1] = val;
-            tgState->vram[((y+yOffset)*tgState->width+(x+xOffset))*4+2] = val;
-            tgState->vram[((y+yOffset)*tgState->width+(x+xOffset))*4+3] = 255;
+    const int ninth = FONT437_HAS_NINTH(c);
+    const int bytesPerPixel = tgState->bytesPerPixel;
+    for (int yOffset=0; yOffset<FONT437_HEIGHT; yOffset++) {
+        //9 bits wide: the table's 8, then the 9th column
+        uint16_t row = (uint16_t)(font437[c][yOffset] << 1) | (ninth ? font437[c][yOffset] & 1 : 0);
+        uint8_t *pixel = &tgState->vram[((y+yOffset)*tgState->width+x)*bytesPerPixel];
+        for (int xOffset=0; xOffset<FONT437_WIDTH; xOffset++) {
+            uint32_t val = (row & (0x100 >> xOffset)) ? tgState->ink : tgState->paper;
+            putPixel(pixel + xOffset*bytesPerPixel, bytesPerPixel, val);
         }
     }
 }
 
-void scrollUp(TermGraphicsState *tgState, int numLines) {
-    const int heightLines = tgState->height / tgState->charHeight;
-    for (int y=numLines; y<heightLines; y++) {
-        memcpy(&tgState->vram[(y-numLines)*tgState->width*tgState->charHeight*4], &tgState->vram[y*tgState->width*tgState->charHeight*4], tgState->width*tgState->charHeight*4);
+//Draws every cell that changed since it was last drawn, everything else in vram is left alone. Cells and the text
+//rows of vram are both kept in physical row order, so this doesn't care where rows are on screen.
+void drawDirtyCells(TermGraphicsState *tgState) {
+    if (!tgState->dirty) {
+        return;
     }
-    
-    for (int i=(heightLines-numLines)*tgState->charHeight*tgState->width; i<tgState->width*tgState->height; i++) {
-        tgState->vram[i*4+0] = 0;
-        tgState->vram[i*4+1] = 0;
-        tgState->vram[i*4+2] = 0;
-        tgState->vram[i*4+3] = 255;
+    for (int row=0; row<tgState->rows; row++) {
+        TermCell *cells = &tgState->cells[row * tgState->cols];
+        for (int col=0; col<tgState->cols; col++) {
+            if (cells[col].attr & TERM_CELL_DIRTY) {
+                cells[col].attr &= ~TERM_CELL_DIRTY;
+                drawChar(tgState, col * tgState->charWidth, row * tgState->charHeight, cells[col].c);
+            }
+        }
     }
-    
+    tgState->dirty = false;
+}
+
+//Where physical row is on screen
+static int screenRow(TermGraphicsState *tgState, int row) {
+    for (int i=0; i<tgState->rows; i++) {
+        if (tgState->rowMap[i] == row) {
+            return i;
+        }
+    }
+    return tgState->rows;
+}
+
+//Brings vram up to date with the cells and draws the cursor over them as a block when it's shown. Only a cursor
+//that moved or blinked counts as damage, cells changed under it already did.
+void drawTerminal(TermGraphicsState *tgState, bool showCursor) {
+    int col = cursorCol(tgState);
+    int row = cursorRow(tgState);
+    TermCell *cell = cellAt(tgState, col, row);
+    bool shown = showCursor && cell != NULL;
+    bool same = shown && col == tgState->drawnCursorCol && tgState->rowMap[row] == tgState->drawnCursorRow;
+    int drawnCol = tgState->drawnCursorCol;
+    int drawnRow = tgState->drawnCursorRow;
+    if (tgState->drawnCursorShown && !same && drawnCol < tgState->cols && drawnRow < tgState->rows) {
+        tgState->cells[drawnRow * tgState->cols + drawnCol].attr |= TERM_CELL_DIRTY;
+        tgState->dirty = true;
+        damageCells(tgState, screenRow(tgState, drawnRow), drawnCol, drawnCol + 1);
+    }
+    drawDirtyCells(tgState);
+
+    if (shown) {
+        if (!same || !tgState->drawnCursorShown) {
+            damageCells(tgState, row, col, col + 1);
+        }
+        drawChar(tgState, col * tgState->charWidth, tgState->rowMap[row] * tgState->charHeight, 219);
+        tgState->drawnCursorCol = col;
+        tgState->drawnCursorRow = tgState->rowMap[row];
+    }
+    tgState->drawnCursorShown = shown;
+}
+
+//Where byte ofs of the screen, as the guest and the caller see it, is in vram
+uint32_t screenToVram(const TermGraphicsState *tgState, uint32_t ofs) {
+    uint32_t rowBytes = tgState->width * tgState->charHeight * tgState->bytesPerPixel;
+    uint32_t row = ofs / rowBytes;
+    if (row >= tgState->rows) {
+        return ofs; //Below the last text row, which is never moved
+    }
+    return tgState->rowMap[row] * rowBytes + ofs % rowBytes;
+}
+
+//Copies the screen out of vram into dst in the order it's shown, a text row at a time
+void copyScreen(const TermGraphicsState *tgState, uint8_t *dst) {
+    size_t rowBytes = (size_t)tgState->width * tgState->charHeight * tgState->bytesPerPixel;
+    for (int row=0; row<tgState->rows; row++) {
+        memcpy(dst + row * rowBytes, tgState->vram + tgState->rowMap[row] * rowBytes, rowBytes);
+    }
+    size_t textBytes = tgState->rows * rowBytes;
+    size_t screenBytes = (size_t)tgState->width * tgState->height * tgState->bytesPerPixel;
+    memcpy(dst + textBytes, tgState->vram + textBytes, screenBytes - textBytes);
+}
+
+//copyScreen for only the part of the screen in rect
+void copyScreenRect(const TermGraphicsState *tgState, uint8_t *dst, const TermRect *rect) {
+    for (int y=rect->y; y<rect->y+rect->height; y++) {
+        uint32_t ofs = (y * tgState->width + rect->x) * tgState->bytesPerPixel;
+        memcpy(dst + ofs, tgState->vram + screenToVram(tgState, ofs), rect->width * tgState->bytesPerPixel);
+    }
+}
+
+static void reverseRows(TermGraphicsState *tgState, int first, int last) {
+    for (; first < last; first++, last--) {
+        uint16_t row = tgState->rowMap[first];
+        tgState->rowMap[first] = tgState->rowMap[last];
+        tgState->rowMap[last] = row;
+    }
+}
+
+//Moves rows [top, bottom] of the screen by numLines, up for a positive numLines and down for a negative one. Only
+//the row map changes (rotated by three reversals), the rows brought in are blanked and nothing else needs drawing
+//again.
+static void scrollRegion(TermGraphicsState *tgState, int top, int bottom, int numLines) {
+    int height = bottom - top + 1;
+    if (height <= 0 || numLines == 0) {
+        return;
+    }
+    int shift = numLines > 0 ? numLines : -numLines;
+    if (shift > height) {
+        shift = height;
+    }
+    //Up is rotating the region left by shift, down is rotating it left by the rest of it
+    int split = numLines > 0 ? shift : height - shift;
+    reverseRows(tgState, top, top + split - 1);
+    reverseRows(tgState, top + split, bottom);
+    reverseRows(tgState, top, bottom);
+    //Everything in the region moved on screen
+    damageBands(tgState, top, bottom + 1, 0, tgState->width);
+    if (numLines > 0) {
+        clearRows(tgState, bottom - shift + 1, bottom + 1);
+    } else {
+        clearRows(tgState, top, top + shift);
+    }
+}
+
+//Scrolls the scroll region (the whole screen unless DECSTBM set one) and moves the cursor up with it
+void scrollUp(TermGraphicsState *tgState, int numLines) {
+    scrollRegion(tgState, tgState->scrollTop, tgState->scrollBottom, numLines);
     tgState->cursorY -= tgState->charHeight * numLines;
 }
 
 //Not really sure how scrolling down is supposed to work...
 void scrollDown(TermGraphicsState *tgState, int numLines) {
-    const int heightLines = tgState->height / tgState->charHeight;
-    for (int y=heightLines-1; y>=numLines; y--) {
-        memcpy(&tgState->vram[y*tgState->width*tgState->charHeight*4], &tgState->vram[(y-numLines)*tgState->width*tgState->charHeight*4], tgState->width*tgState->charHeight*4);
-    }
-    
-    for (int i=0; i<numLines*tgState->charHeight*tgState->width; i++) {
-        tgState->vram[i*4+0] = 0;
-        tgState->vram[i*4+1] = 0;
-        tgState->vram[i*4+2] = 0;
-        tgState->vram[i*4+3] = 255;
-    }
+    scrollRegion(tgState, tgState->scrollTop, tgState->scrollBottom, -numLines);
     
     //cursorY -= charHeight * numLines;
 }
 
+//The clears below all leave the cursor where it is, and do nothing for rows it's off screen from
 void clearFromCursorRight(TermGraphicsState *tgState) {
-    for (int y=0; y<tgState->charHeight; y++) {
-        for (int x=tgState->cursorX*tgState->charWidth; x<tgState->width; x++) {
-            tgState->vram[(y*tgState->width+x)*4+0] = 0;
-            tgState->vram[(y*tgState->width+x)*4+1] = 0;
-            tgState->vram[(y*tgState->width+x)*4+2] = 0;
-            tgState->vram[(y*tgState->width+x)*4+3] = 255;
-        }
-    }
+    clearCells(tgState, cursorRow(tgState), cursorCol(tgState), tgState->cols);
 }
 
 void clearFromCursorDown(TermGraphicsState *tgState) {
     clearFromCursorRight(tgState);
-    for (int i=(tgState->cursorY+tgState->charHeight)*tgState->width; i<tgState->width*tgState->height; i++) {
-        tgState->vram[i*4+0] = 0;
-        tgState->vram[i*4+1] = 0;
-        tgState->vram[i*4+2] = 0;
-        tgState->vram[i*4+3] = 255;
-    }
+    clearRows(tgState, cursorRow(tgState) + 1, tgState->rows);
 }
 
 void clearFromCursorLeft(TermGraphicsState *tgState) {
-    for (int y=0; y<tgState->charHeight; y++) {
-        memset(&tgState->vram[(tgState->cursorY+y)*tgState->width*4], 0, tgState->cursorX*4);
-    }
+    int col = cursorCol(tgState);
+    clearCells(tgState, cursorRow(tgState), 0, col < tgState->cols ? col + 1 : tgState->cols);
 }
 
 void clearFromCursorUp(TermGraphicsState *tgState) {
     clearFromCursorLeft(tgState);
-    for (int i=0; i<tgState->cursorY*tgState->charWidth; i++) {
-        tgState->vram[i*4+0] = 0;
-        tgState->vram[i*4+1] = 0;
-        tgState->vram[i*4+2] = 0;
-        tgState->vram[i*4+3] = 255;
-    }
+    int row = cursorRow(tgState);
+    clearRows(tgState, 0, row < tgState->rows ? row : tgState->rows);
 }
 
 void clearLine(TermGraphicsState *tgState) {
-    for (int i=tgState->cursorY*tgState->width; i<(tgState->cursorY+1)*tgState->width; i++) {
-        tgState->vram[i*4+0] = 0;
-        tgState->vram[i*4+1] = 0;
-        tgState->vram[i*4+2] = 0;
-        tgState->vram[i*4+3] = 255;
-    }
-}
-
-typedef enum {
-    NORMAL,
-    ESC,
-    ESC_BRACKET,
-    ESC_OPEN_PAREN,
-    ESC_CLOSE_PAREN,
-    ESC_POUND,
-    ESC_FIVE,
-    ESC_SIX,
-    ESC_BRACKET_NUM,
-    ESC_BRACKET_NUM_SEMI,
-    ESC_BRACKET_NUM_SEMI_NUM,
-    ESC_BRACKET_QUESTION,
-    ESC_BRACKET_QUESTION_NUM,
-    ESC_BRACKET_SEMI,
-} TerminalState;
+    clearCells(tgState, cursorRow(tgState), 0, tgState->cols);
+}
+
+//DECSTBM, with rows counted from 1 and 0 meaning the edge of the screen. Ignored unless it leaves at least two rows.
+static void setScrollRegion(TermGraphicsState *tgState, int top, int bottom) {
+    if (top == 0) {
+        top = 1;
+    }
+    if (bottom == 0 || bottom > tgState->rows) {
+        bottom = tgState->rows;
+    }
+    if (top < 1 || top >= bottom) {
+        return;
+    }
+    tgState->scrollTop = top - 1;
+    tgState->scrollBottom = bottom - 1;
+    tgState->cursorX = 0;
+    tgState->cursorY = 0;
+}
 
 void writeChar(TermGraphicsState *tgState, char c) {
-    static TerminalState state = NORMAL;
-    static int numA = 0;
-    static int numB = 0;
-    
-    switch (state) {
+    switch (tgState->escState) {
         case NORMAL: {
             if (c == 27) { //Escape code
-                state = ESC;
+                tgState->escState = ESC;
                 break;
             }
             
             if (c != '\n' && c != '\r' && c != 8 /*Backspace*/ && c != 7 /*Bell*/) {
-                drawChar(tgState, tgState->cursorX, tgState->cursorY, c);
+                setCell(tgState, cursorCol(tgState), cursorRow(tgState), c);
             } else {
-                drawChar(tgState, tgState->cursorX, tgState->cursorY, ' ');
+                setCell(tgState, cursorCol(tgState), cursorRow(tgState), ' ');
             }
             
             if (c == 8 /*Backspace*/) {
@@ -155,129 +429,136 @@ void writeChar(TermGraphicsState *tgState, char c) {
                 break;
             }
 
+            int oldRow = cursorRow(tgState);
             tgState->cursorX += tgState->charWidth;
             if (tgState->cursorX >= tgState->width - tgState->charWidth || c == '\n') {
                 tgState->cursorX = 0;
                 tgState->cursorY += tgState->charHeight;
             }
 
-            if (tgState->cursorY > tgState->height - tgState->charHeight) {
+            //Going past the bottom of the scroll region scrolls it, anywhere else the screen's last row is as far
+            //as the cursor goes
+            int row = cursorRow(tgState);
+            if (row > oldRow && oldRow == tgState->scrollBottom) {
                 scrollUp(tgState, 1);
+            } else if (row >= tgState->rows) {
+                tgState->cursorY = (tgState->rows - 1) * tgState->charHeight;
             }
             break;
         }
         case ESC: {
             switch (c) {
                 case '[': {
-                    state = ESC_BRACKET;
+                    tgState->escState = ESC_BRACKET;
                     break;
                 }
                 
                 case '=': { //Set alternate keypad mode TODO: Decide what we're gonna do about keypad modes
                     printf("Set alternate keypad mode\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '>': { //Set numeric keypad mode TODO: Decide what we're gonna do about keypad modes
                     printf("Set numeric keypad mode\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case '(': {
-                    state = ESC_OPEN_PAREN;
+                    tgState->escState = ESC_OPEN_PAREN;
                     break;
                 }
                 case ')': {
-                    state = ESC_CLOSE_PAREN;
+                    tgState->escState = ESC_CLOSE_PAREN;
                     break;
                 }
                 
                 case 'N': { //Set single shift 2
                     printf("Set single shift 2\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'O': { //Set single shift 3
                     printf("Set single shift 3\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'D': { //Move/scroll window up one line FIXME: I don't think this is quite right...
                     printf("Move/scroll window up one line\n");
                     scrollUp(tgState, 1);
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'M': { //Move/scroll window down one line FIXME: I don't think this is quite right...
                     printf("Move/scroll window down one line\n");
                     scrollDown(tgState, 1);
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'E': { //Move to next line FIXME: I don't think this is quite right...
                     printf("Move to next line\n");
                     scrollUp(tgState, 1);
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '7': { //Save cursor position and attributes
                     printf("Save cursor position and attributes\n");
                     tgState->backupCursorX = tgState->cursorX;
                     tgState->backupCursorY = tgState->cursorY;
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '8': { //Restore cursor position and attributes
                     printf("Restore cursor position and attributes\n");
                     tgState->cursorX = tgState->backupCursorX;
                     tgState->cursorY = tgState->backupCursorY;
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'H': { //Set a tab at the current column TODO: Figure out what all this tab stuff is supposed to do
                     printf("Set a tab at the current column\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case '#': {
-                    state = ESC_POUND;
+                    tgState->escState = ESC_POUND;
                     break;
                 }
                 
                 case '5': {
-                    state = ESC_FIVE;
+                    tgState->escState = ESC_FIVE;
                     break;
                 }
                 
                 case '6': {
-                    state = ESC_SIX;
+                    tgState->escState = ESC_SIX;
                     break;
                 }
                 
                 case 'c': { //Reset terminal to initial state
                     printf("Reset terminal to initial state\n");
+                    resetScrollRegion(tgState);
                     clearScreen(tgState);
                     tgState->cursorX = 0;
                     tgState->cursorY = 0;
                     tgState->backupCursorX = 0;
                     tgState->backupCursorY = 0;
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case '<': { //Toggle ANSI mode TODO: Implement ANSI mode
                     printf("Toggle ANSI mode\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -286,13 +567,19 @@ void writeChar(TermGraphicsState *tgState, char c) {
         case ESC_BRACKET: {
             switch (c) {
                 case '?': {
-                    state = ESC_BRACKET_QUESTION;
+                    tgState->escState = ESC_BRACKET_QUESTION;
+                    break;
+                }
+                
+                case 'r': { //Scroll the whole screen again (DECSTBM)
+                    setScrollRegion(tgState, 0, 0);
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'm': { //Turn off character attributes TODO: Implement character attributes
                     printf("Turn off character attributes\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
@@ -300,55 +587,55 @@ void writeChar(TermGraphicsState *tgState, char c) {
                     printf("Move cursor to upper left corner\n");
                     tgState->cursorX = 0;
                     tgState->cursorY = 0;
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case ';': {
-                    state = ESC_BRACKET_SEMI;
+                    tgState->escState = ESC_BRACKET_SEMI;
                     break;
                 }
                 case 'f': { //Move cursor to upper left corner
                     printf("Move cursor to upper left corner\n");
                     tgState->cursorX = 0;
                     tgState->cursorY = 0;
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'g': { //Clear a tab at the current column TODO: Figure out what all this tab stuff is supposed to do
                     printf("Clear a tab at the current column\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'K': { //Clear line from cursor right
                     printf("Clear line from cursor right\n");
                     clearFromCursorRight(tgState);
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'J': { //Clear screen from cursor down
                     printf("Clear screen from cursor down\n");
                     clearFromCursorDown(tgState);
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'c': { //Identify what terminal type TODO: Setup keyboard buffer to respond to this
                     printf("Identify what terminal type\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 default: {
                     if (c >= '0' && c <= '9') {
-                        numA = c - '0';
-                        state = ESC_BRACKET_NUM;
+                        tgState->escNumA = c - '0';
+                        tgState->escState = ESC_BRACKET_NUM;
                         break;
                     } 
                     printf("Invalid escape code ESC_BRACKET\n"); //Invalid escape code
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -358,32 +645,32 @@ void writeChar(TermGraphicsState *tgState, char c) {
             switch (c) {
                 case 'A': { //Set United Kingdom G0 character set TODO: Figure out if we even need these
                     printf("Set United Kingdom G0 character set\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'B': { //Set United States G0 character set TODO: Figure out if we even need these
                     printf("Set United States G0 character set\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '0': { //Set G0 special chars. & line set TODO: Figure out if we even need these
                     printf("Set G0 special chars. & line set\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '1': { //Set G0 alternate character ROM TODO: Figure out if we even need these
                     printf("Set G0 alternate character ROM\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '2': { //Set G0 alt char ROM and spec. graphics TODO: Figure out if we even need these
                     printf("Set G0 alt char ROM and spec. graphics\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC_OPEN_PAREN\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -393,32 +680,32 @@ void writeChar(TermGraphicsState *tgState, char c) {
             switch (c) {
                 case 'A': { //Set United Kingdom G1 character set TODO: Figure out if we even need these
                     printf("Set United Kingdom G1 character set\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'B': { //Set United States G1 character set TODO: Figure out if we even need these
                     printf("Set United States G1 character set\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '0': { //Set G1 special chars. & line set TODO: Figure out if we even need these
                     printf("Set G1 special chars. & line set\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '1': { //Set G1 alternate character ROM TODO: Figure out if we even need these
                     printf("Set G1 alternate character ROM\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '2': { //Set G1 alt char ROM and spec. graphics TODO: Figure out if we even need these
                     printf("Set G1 alt char ROM and spec. graphics\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC_CLOSE_PAREN\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -428,33 +715,33 @@ void writeChar(TermGraphicsState *tgState, char c) {
             switch (c) {
                 case '3': { //Double-height letters, top half TODO: Implement
                     printf("Double-height letters, top half\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '4': { //Double-height letters, bottom half TODO: Implement
                     printf("Double-height letters, bottom half\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '5': { //Single width, single height letters TODO: Implement
                     printf("Single width, single height letters\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case '6': { //Double width, single height letters TODO: Implement
                     printf("Double width, single height letters\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case '8': { //Screen alignment display TODO: What is this even supposed to do?
                     printf("Screen alignment display\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC_POUND\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -464,12 +751,12 @@ void writeChar(TermGraphicsState *tgState, char c) {
             switch (c) {
                 case 'n': { //Device status report TODO: Setup keyboard buffer to respond to this
                     printf("Device status report\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC_FIVE\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -479,12 +766,12 @@ void writeChar(TermGraphicsState *tgState, char c) {
             switch (c) {
                 case 'n': { //Get cursor position TODO: Setup keyboard buffer to respond to this
                     printf("Get cursor position\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC_SIX\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -492,219 +779,224 @@ void writeChar(TermGraphicsState *tgState, char c) {
         }
         case ESC_BRACKET_NUM: {
             switch (c) {
+                case 'r': { //Set the top line of the scroll region (DECSTBM)
+                    setScrollRegion(tgState, tgState->escNumA, 0);
+                    tgState->escState = NORMAL;
+                    break;
+                }
                 case 'h': {
-                    if (numA == 20) { //Set new line mode TODO: Figure out what this is supposed to do
+                    if (tgState->escNumA == 20) { //Set new line mode TODO: Figure out what this is supposed to do
                         printf("Set new line mode\n");
-                        state = NORMAL;
+                        tgState->escState = NORMAL;
                         break;
                     } else { //Invalid escape code
                         printf("Invalid escape code ESC_BRACKET_NUM_h\n");
-                        state = NORMAL;
+                        tgState->escState = NORMAL;
                         break;
                     }
                 }
                 case 'l': {
-                    if (numA == 20) { //Set line feed mode TODO: Figure out what this is supposed to do
+                    if (tgState->escNumA == 20) { //Set line feed mode TODO: Figure out what this is supposed to do
                         printf("Set line feed mode\n");
-                        state = NORMAL;
+                        tgState->escState = NORMAL;
                         break;
                     } else { //Invalid escape code
                         printf("Invalid escape code ESC_BRACKET_NUM_l\n");
-                        state = NORMAL;
+                        tgState->escState = NORMAL;
                         break;
                     }
                 }
                 case 'm': {
-                    switch (numA) {
+                    switch (tgState->escNumA) {
                         case 0: { //Turn off character attributes TODO: Implement character attributes
                             printf("Turn off character attributes\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 1: { //Turn bold mode on TODO: Implement character attributes
                             printf("Turn bold mode on\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 2: { //Turn low intensity mode on TODO: Implement character attributes
                             printf("Turn low intensity mode on\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 4: { //Turn underline mode on TODO: Implement character attributes
                             printf("Turn underline mode on\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 5: { //Turn blinking mode on TODO: Implement character attributes
                             printf("Turn blinking mode on\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 7: { //Turn reverse video on TODO: Implement character attributes
                             printf("Turn reverse video on\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 8: { //Turn invisible text mode on TODO: Implement character attributes
                             printf("Turn invisible text mode on\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_NUM_m\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
                     break;
                 }
                 case ';': {
-                    state = ESC_BRACKET_NUM_SEMI;
+                    tgState->escState = ESC_BRACKET_NUM_SEMI;
                     break;
                 }
                 
                 case 'A': { //Move cursor up numA lines
                     printf("Move cursor up numA lines\n");
-                    tgState->cursorY -= tgState->charHeight * numA;
-                    state = NORMAL;
+                    tgState->cursorY -= tgState->charHeight * tgState->escNumA;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'B': { //Move cursor down numA lines
                     printf("Move cursor down numA lines\n");
-                    tgState->cursorY += tgState->charHeight * numA;
-                    state = NORMAL;
+                    tgState->cursorY += tgState->charHeight * tgState->escNumA;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'C': { //Move cursor right numA lines
                     printf("Move cursor right numA lines\n");
-                    tgState->cursorX += tgState->charWidth * numA;
-                    state = NORMAL;
+                    tgState->cursorX += tgState->charWidth * tgState->escNumA;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'D': { //Move cursor left numA lines
                     printf("Move cursor left numA lines\n");
-                    tgState->cursorX -= tgState->charWidth * numA;
-                    state = NORMAL;
+                    tgState->cursorX -= tgState->charWidth * tgState->escNumA;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 
                 case 'g': {
-                    switch (numA) {
+                    switch (tgState->escNumA) {
                         case 0: { //Clear a tab at the current column TODO: Figure out what all this tab stuff is supposed to do
                             printf("Clear a tab at the current column\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 3: { //Clear all tabs TODO: Figure out what all this tab stuff is supposed to do
                             printf("Clear all tabs\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_NUM_g\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
                     break;
                 }
                 case 'K': {
-                    switch (numA) {
+                    switch (tgState->escNumA) {
                         case 0: { //Clear line from cursor right
                             printf("Clear line from cursor right\n");
                             clearFromCursorRight(tgState);
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 1: { //Clear line from cursor left
                             printf("Clear line from cursor left\n");
                             clearFromCursorLeft(tgState);
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 2: { //Clear entire line
                             printf("Clear entire line\n");
                             clearLine(tgState);
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_NUM_K\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
                     break;
                 }
                 case 'J': {
-                    switch (numA) {
+                    switch (tgState->escNumA) {
                         case 0: { //Clear screen from cursor down
                             printf("Clear screen from cursor down\n");
                             clearFromCursorDown(tgState);
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 1: { //Clear screen from cursor up
                             printf("Clear screen from cursor up\n");
                             clearFromCursorUp(tgState);
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 2: { //Clear entire screen
                             printf("Clear entire screen\n");
                             clearScreen(tgState);
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_NUM_J\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
                     break;
                 }
                 case 'c': {
-                    if (numA == 0) { //Identify what terminal type (another) TODO: Setup keyboard buffer to respond to this
+                    if (tgState->escNumA == 0) { //Identify what terminal type (another) TODO: Setup keyboard buffer to respond to this
                         printf("Identify what terminal type (another)\n");
-                        state = NORMAL;
+                        tgState->escState = NORMAL;
                     } else { //Invalid escape code
                         printf("Invalid escape code ESC_BRACKET_NUM_c\n");
-                        state = NORMAL;
+                        tgState->escState = NORMAL;
                     }
                     break;
                 }
                 case 'q': {
-                    switch (numA) {
+                    switch (tgState->escNumA) {
                         case 0: { //Turn off all four leds TODO: Implement the leds
                             printf("Turn off all four leds\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 1: { //Turn on LED #1 TODO: Implement the leds
                             printf("Turn on LED #1\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 2: { //Turn on LED #2 TODO: Implement the leds
                             printf("Turn on LED #2\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 3: { //Turn on LED #3 TODO: Implement the leds
                             printf("Turn on LED #3\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 4: { //Turn on LED #4 TODO: Implement the leds
                             printf("Turn on LED #4\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_NUM_q\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
@@ -712,12 +1004,12 @@ void writeChar(TermGraphicsState *tgState, char c) {
                 }
                 default: {
                     if (c >= '0' && c <= '9') {
-                        numA *= 10;
-                        numA += c - '0';
+                        tgState->escNumA *= 10;
+                        tgState->escNumA += c - '0';
                         break;
                     }
                     printf("Invalid escape code ESC_BRACKET_NUM\n");
-                    state = NORMAL; //Invalid escape code
+                    tgState->escState = NORMAL; //Invalid escape code
                     break;
                 }
             }
@@ -725,65 +1017,65 @@ void writeChar(TermGraphicsState *tgState, char c) {
         }
         case ESC_BRACKET_NUM_SEMI: {
             if (c >= '0' && c <= '9') {
-                numB = c - '0';
-                state = ESC_BRACKET_NUM_SEMI_NUM;
+                tgState->escNumB = c - '0';
+                tgState->escState = ESC_BRACKET_NUM_SEMI_NUM;
                 break;
             }
             printf("Invalid escape code ESC_BRACKET_NUM_SEMI\n");
-            state = NORMAL; //Invalid escape code
+            tgState->escState = NORMAL; //Invalid escape code
             break;
         }
         case ESC_BRACKET_NUM_SEMI_NUM: {
             switch (c) {
-                case 'r': { //Set top and bottom line's of a window TODO: Figure out what this is supposed to do
-                    printf("Set top and bottom line's of a window\n");
-                    state = NORMAL;
+                case 'r': { //Set top and bottom lines of the scroll region (DECSTBM), also homes the cursor
+                    setScrollRegion(tgState, tgState->escNumA, tgState->escNumB);
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'H': { //Move cursor to screen location numB, numA NOTE: Coordinates come in y, x format, (1, 1) is the top left corner
                     printf("Move cursor to screen location numB, numA\n");
-                    tgState->cursorX = (numB - 1) * tgState->charWidth;
-                    tgState->cursorY = (numA - 1) * tgState->charHeight;
-                    state = NORMAL;
+                    tgState->cursorX = (tgState->escNumB - 1) * tgState->charWidth;
+                    tgState->cursorY = (tgState->escNumA - 1) * tgState->charHeight;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'f': { //Move cursor to screen location numB, numA NOTE: Coordinates come in y, x format, (1, 1) is the top left corner
                     printf("Move cursor to screen location numB, numA\n");
-                    tgState->cursorX = (numB - 1) * tgState->charWidth;
-                    tgState->cursorY = (numA - 1) * tgState->charHeight;
-                    state = NORMAL;
+                    tgState->cursorX = (tgState->escNumB - 1) * tgState->charWidth;
+                    tgState->cursorY = (tgState->escNumA - 1) * tgState->charHeight;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'y': { //Terminal self tests
-                    if (numA != 2) { //Invalid escape code
-                        state = NORMAL;
+                    if (tgState->escNumA != 2) { //Invalid escape code
+                        tgState->escState = NORMAL;
                         break;
                     }
                     
-                    switch (numB) {
+                    switch (tgState->escNumB) {
                         case 1: { //Confidence power up test TODO: Figure out what this is supposed to do
                             printf("Confidence power up test\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 2: { //Confidence loopback test TODO: Figure out what this is supposed to do
                             printf("Confidence loopback test\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 9: { //Repeat power up test TODO: Figure out what this is supposed to do
                             printf("Repeat power up test\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 10: { //Repeat loopback test TODO: Figure out what this is supposed to do
                             printf("Repeat loopback test\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_NUM_SEMI_NUM_y\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
@@ -791,12 +1083,12 @@ void writeChar(TermGraphicsState *tgState, char c) {
                 }
                 default: {
                     if (c >= '0' && c <= '9') {
-                        numB *= 10;
-                        numB += c - '0';
+                        tgState->escNumB *= 10;
+                        tgState->escNumB += c - '0';
                         break;
                     }
                     printf("Invalid escape code ESC_BRACKET_NUM_SEMI_NUM\n");
-                    state = NORMAL; //Invalid escape code
+                    tgState->escState = NORMAL; //Invalid escape code
                     break;
                 }
             }
@@ -804,116 +1096,116 @@ void writeChar(TermGraphicsState *tgState, char c) {
         }
         case ESC_BRACKET_QUESTION: {
             if (c >= '1' && c <= '9') {
-                numA = c - '0';
-                state = ESC_BRACKET_QUESTION_NUM;
+                tgState->escNumA = c - '0';
+                tgState->escState = ESC_BRACKET_QUESTION_NUM;
                 break;
             }
             printf("Invalid escape code ESC_BRACKET_QUESTION\n");
-            state = NORMAL; //Invalid escape code
+            tgState->escState = NORMAL; //Invalid escape code
             break;
         }
         case ESC_BRACKET_QUESTION_NUM: {
             switch (c) {
                 case 'h': {
-                    switch (numA) {
+                    switch (tgState->escNumA) {
                         case 1: { //Set cursor key to application TODO: Figure out what this is supposed to do
                             printf("Set cursor key to application\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 3: { //Set number of columns to 132 TODO: Figure out what this is supposed to do
                             printf("Set number of columns to 132\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 4: { //Set smooth scrolling TODO: Implement smooth scrolling
                             printf("Set smooth scrolling\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 5: { //Set reverse video on screen TODO: Implement reverse video
                             printf("Set reverse video on screen\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 6: { //Set origin to relative TODO: Figure out what this is supposed to do
                             printf("Set origin to relative\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 7: { //Set auto-wrap mode TODO: Figure out what this is supposed to do
                             printf("Set auto-wrap mode\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 8: { //Set auto-repeat mode TODO: Figure out what this is supposed to do
                             printf("Set auto-repeat mode\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 9: { //Set interlacing mode NOTE: This probably will never do anything
                             printf("Set interlacing mode\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_QUESTION_NUM_h\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
                     break;
                 }
                 case 'l': {
-                    switch (numA) {
+                    switch (tgState->escNumA) {
                         case 1: { //Set cursor key to cursor TODO: Figure out what this is supposed to do
                             printf("Set cursor key to cursor\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 2: { //Set VT52 (versus ANSI) TODO: Figure out if we want this
                             printf("Set VT52 (versus ANSI)\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 3: { //Set number of columns to 80 TODO: Figure out exactly what this is supposed to do
                             printf("Set number of columns to 80\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 4: { //Set jump scrolling TODO: Implement smooth scrolling
                             printf("Set jump scrolling\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 5: { //Set normal video on screen TODO: Implement reverse video
                             printf("Set normal video on screen\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 6: { //Set origin to absolute TODO: Figure out what this is supposed to do
                             printf("Set origin to absolute\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 7: { //Reset auto-wrap mode TODO: Figure out what this is supposed to do
                             printf("Reset auto-wrap mode\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 8: { //Reset auto-repeat mode TODO: Figure out what this is supposed to do
                             printf("Reset auto-repeat mode\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         case 9: { //Reset interlacing mode NOTE: This probably will never do anything
                             printf("Reset interlacing mode\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                         default: { //Invalid escape code
                             printf("Invalid escape code ESC_BRACKET_QUESTION_NUM_l\n");
-                            state = NORMAL;
+                            tgState->escState = NORMAL;
                             break;
                         }
                     }
@@ -921,7 +1213,7 @@ void writeChar(TermGraphicsState *tgState, char c) {
                 }
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC_BRACKET_QUESTION_NUM\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -933,19 +1225,19 @@ void writeChar(TermGraphicsState *tgState, char c) {
                     printf("Move cursor to upper left corner\n");
                     tgState->cursorX = 0;
                     tgState->cursorY = 0;
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 case 'f': { //Move cursor to upper left corner
                     printf("Move cursor to upper left corner\n");
                     tgState->cursorX = 0;
                     tgState->cursorY = 0;
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
                 default: { //Invalid escape code
                     printf("Invalid escape code ESC_BRACKET_SEMI\n");
-                    state = NORMAL;
+                    tgState->escState = NORMAL;
                     break;
                 }
             }
@@ -953,7 +1245,7 @@ void writeChar(TermGraphicsState *tgState, char c) {
         }
         default: {
             printf("TODO: Implement the rest of the escape code stuff\n");
-            state = NORMAL;
+            tgState->escState = NORMAL;
             break;
         }
     }
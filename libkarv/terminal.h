@@ -3,16 +3,58 @@
  | Header file for terminal.c                                                    |
 \*------------------------------------------------------------------------------*/
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    NORMAL,
+    ESC,
+    ESC_BRACKET,
+    ESC_OPEN_PAREN,
+    ESC_CLOSE_PAREN,
+    ESC_POUND,
+    ESC_FIVE,
+    ESC_SIX,
+    ESC_BRACKET_NUM,
+    ESC_BRACKET_NUM_SEMI,
+    ESC_BRACKET_NUM_SEMI_NUM,
+    ESC_BRACKET_QUESTION,
+    ESC_BRACKET_QUESTION_NUM,
+    ESC_BRACKET_SEMI,
+} TerminalState;
+
+//One character on screen
+typedef struct {
+    uint8_t c;    //Code page 437
+    uint8_t attr; //TERM_CELL_* bits
+} TermCell;
+
+#define TERM_CELL_DIRTY 0x80 //Changed since it was last drawn into vram
+
+//Part of the screen, in pixels
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+} TermRect;
+
+//The pixels of a band that changed, [left, right), empty when left >= right
+typedef struct {
+    uint16_t left;
+    uint16_t right;
+} TermSpan;
 
 typedef struct {
     uint8_t *vram;
     uint16_t width;
     uint16_t height;
+    //vram's pixel format: how big a pixel is, and the pixels text is drawn with (little endian, bytesPerPixel of them)
+    uint8_t bytesPerPixel;
+    uint32_t ink;
+    uint32_t paper;
     
-    uint8_t *font;
-    int fontWidth;
-    int fontHeight;
     uint16_t charWidth;
     uint16_t charHeight;
     
@@ -20,10 +62,47 @@ typedef struct {
     uint16_t cursorY;
     uint16_t backupCursorX;
     uint16_t backupCursorY;
+
+    //Escape sequence parser, kept here so every terminal parses on its own
+    TerminalState escState;
+    int escNumA;
+    int escNumB;
+
+    //What's on screen, writing only changes these and drawTerminal brings vram up to date. Rows of cells, and the
+    //text rows of vram, are stored in whatever order scrolling left them in: rowMap has the physical row of each
+    //row on screen, so scrolling only has to rotate it. rowMap and cells are one allocation, see terminalTextSize.
+    uint16_t *rowMap;
+    TermCell *cells; //rows of cols, in physical order
+    uint16_t cols;
+    uint16_t rows;
+    bool dirty; //Some cell has TERM_CELL_DIRTY set
+    uint16_t drawnCursorCol; //Where drawTerminal last drew the cursor, physical
+    uint16_t drawnCursorRow;
+    bool drawnCursorShown; //vram has the cursor's block there
+    uint16_t scrollTop; //The rows on screen that scroll, all of them unless DECSTBM says otherwise
+    uint16_t scrollBottom;
+
+    //What changed on screen since takeDamage, in screen order. One span per band of charHeight pixel rows, the
+    //text rows and then whatever is left below them.
+    TermSpan *damage;
+    uint16_t numBands;
 } TermGraphicsState;
 
+bool initTerminal(TermGraphicsState *tgState);
+void freeTerminal(TermGraphicsState *tgState);
+size_t terminalTextSize(const TermGraphicsState *tgState);
+uint8_t terminalInkGrey(void);
+void resetScrollRegion(TermGraphicsState *tgState);
 void clearScreen(TermGraphicsState *tgState);
 void drawChar(TermGraphicsState *tgState, uint16_t x, uint16_t y, uint8_t c);
+void drawDirtyCells(TermGraphicsState *tgState);
+void drawTerminal(TermGraphicsState *tgState, bool showCursor);
+void damageRect(TermGraphicsState *tgState, int x, int y, int width, int height);
+void damageBytes(TermGraphicsState *tgState, uint32_t ofs, uint32_t len);
+int takeDamage(TermGraphicsState *tgState, TermRect *rects, int max);
+uint32_t screenToVram(const TermGraphicsState *tgState, uint32_t ofs);
+void copyScreen(const TermGraphicsState *tgState, uint8_t *dst);
+void copyScreenRect(const TermGraphicsState *tgState, uint8_t *dst, const TermRect *rect);
 void writeChar(TermGraphicsState *tgState, char c);
 void writeArray(TermGraphicsState *tgState, const char *str, int len);
 void writeString(TermGraphicsState *tgState, const char *str);
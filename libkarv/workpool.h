@@ -0,0 +1,306 @@
+/*-------------------------------------------------------------------------------*\
+ | workpool.h Copyright (c) 2025 StrandedSoftwareDeveloper under the MIT License |
+ | Small work-stealing thread pool, responsibilities include:                    |
+ |  - Keeping a set of worker threads (one per host core by default) parked      |
+ |  - Running a batch of independent items across them and the calling thread    |
+ |  - Balancing uneven batches by letting idle workers steal queued items        |
+ |  - WorkThread, a single background thread for running one job at a time       |
+ |                                                                               |
+ | Built on os_generic.h. Every item is handed out exactly once and              |
+ | WorkPoolRun only returns once all of them are done, so the items can own      |
+ | whatever they touch without any extra locking.                                |
+\*-------------------------------------------------------------------------------*/
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "externalDeps/os_generic.h"
+
+typedef void (*WorkPoolFunc)(void *userData, int item);
+
+//Owner pops from the back, thieves take from the front
+typedef struct {
+    og_mutex_t lock;
+    int *items;
+    int head;
+    int tail;
+} WPDeque;
+
+typedef struct WorkPool WorkPool;
+
+typedef struct {
+    WorkPool *pool;
+    int index;
+} WPWorker;
+
+struct WorkPool {
+    int numThreads; //Including the thread calling WorkPoolRun, which is worker 0
+    og_thread_t *threads;
+    WPWorker *workers;
+    WPDeque *deques;
+    int capacity; //Of each deque
+
+    og_sema_t startSema;
+    og_sema_t doneSema;
+    volatile int quit;
+
+    //The batch being run
+    WorkPoolFunc func;
+    void *userData;
+};
+
+static int WorkPoolHostCores(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int cores = (int)info.dwNumberOfProcessors;
+#else
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return cores > 0 ? cores : 1;
+}
+
+//Takes an item, from our own deque if possible and from everyone else's otherwise. -1 means the batch is drained.
+static int WorkPoolTake(WorkPool *pool, int self) {
+    WPDeque *own = &pool->deques[self];
+    OGLockMutex(own->lock);
+    if (own->tail > own->head) {
+        int item = own->items[--own->tail];
+        OGUnlockMutex(own->lock);
+        return item;
+    }
+    OGUnlockMutex(own->lock);
+
+    for (int i=1; i<pool->numThreads; i++) {
+        WPDeque *victim = &pool->deques[(self + i) % pool->numThreads];
+        OGLockMutex(victim->lock);
+        if (victim->tail > victim->head) {
+            int item = victim->items[victim->head++];
+            OGUnlockMutex(victim->lock);
+            return item;
+        }
+        OGUnlockMutex(victim->lock);
+    }
+    return -1;
+}
+
+static void WorkPoolDrain(WorkPool *pool, int self) {
+    int item;
+    while ((item = WorkPoolTake(pool, self)) >= 0) {
+        pool->func(pool->userData, item);
+    }
+}
+
+static void *WorkPoolThread(void *arg) {
+    WPWorker *worker = arg;
+    WorkPool *pool = worker->pool;
+    for (;;) {
+        OGLockSema(pool->startSema);
+        if (pool->quit) {
+            break;
+        }
+        WorkPoolDrain(pool, worker->index);
+        OGUnlockSema(pool->doneSema);
+    }
+    return NULL;
+}
+
+//numThreads <= 0 means one per host core
+static WorkPool *WorkPoolCreate(int numThreads) {
+    WorkPool *pool = calloc(1, sizeof(WorkPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->numThreads = numThreads > 0 ? numThreads : WorkPoolHostCores();
+    pool->deques = calloc(pool->numThreads, sizeof(WPDeque));
+    pool->workers = calloc(pool->numThreads, sizeof(WPWorker));
+    pool->threads = calloc(pool->numThreads, sizeof(og_thread_t));
+    pool->startSema = OGCreateSema();
+    pool->doneSema = OGCreateSema();
+    for (int i=0; i<pool->numThreads; i++) {
+        pool->deques[i].lock = OGCreateMutex();
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+    for (int i=1; i<pool->numThreads; i++) {
+        pool->threads[i] = OGCreateThread(WorkPoolThread, &pool->workers[i]);
+    }
+    return pool;
+}
+
+static void WorkPoolDestroy(WorkPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pool->quit = 1;
+    for (int i=1; i<pool->numThreads; i++) {
+        OGUnlockSema(pool->startSema);
+    }
+    for (int i=1; i<pool->numThreads; i++) {
+        OGJoinThread(pool->threads[i]);
+    }
+    for (int i=0; i<pool->numThreads; i++) {
+        OGDeleteMutex(pool->deques[i].lock);
+        free(pool->deques[i].items);
+    }
+    OGDeleteSema(pool->startSema);
+    OGDeleteSema(pool->doneSema);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+}
+
+//Calls func(userData, i) for every i in [0, numItems) and waits for all of them.
+//Not reentrant, only one thread may run batches on a given pool at a time.
+static void WorkPoolRun(WorkPool *pool, WorkPoolFunc func, void *userData, int numItems) {
+    if (numItems <= 0) {
+        return;
+    }
+    if (numItems > pool->capacity) {
+        for (int i=0; i<pool->numThreads; i++) {
+            free(pool->deques[i].items);
+            pool->deques[i].items = malloc(numItems * sizeof(int));
+        }
+        pool->capacity = numItems;
+    }
+
+    //Deal the items out round robin, stealing evens out whatever this gets wrong
+    for (int i=0; i<pool->numThreads; i++) {
+        pool->deques[i].head = 0;
+        pool->deques[i].tail = 0;
+    }
+    for (int i=0; i<numItems; i++) {
+        WPDeque *deque = &pool->deques[i % pool->numThreads];
+        deque->items[deque->tail++] = i;
+    }
+    pool->func = func;
+    pool->userData = userData;
+
+    //No point waking more threads than there are items
+    int helpers = (numItems < pool->numThreads ? numItems : pool->numThreads) - 1;
+    for (int i=0; i<helpers; i++) {
+        OGUnlockSema(pool->startSema);
+    }
+    WorkPoolDrain(pool, 0);
+    for (int i=0; i<helpers; i++) {
+        OGLockSema(pool->doneSema);
+    }
+}
+
+typedef void (*WorkThreadFunc)(void *userData);
+
+typedef enum {
+    WORKTHREAD_IDLE,
+    WORKTHREAD_RUNNING,
+    WORKTHREAD_DONE, //Finished, but nobody has called WorkThreadWait yet
+} WorkThreadState;
+
+//Runs jobs in the background one at a time, the owner starts one and later waits for (or polls) it
+typedef struct {
+    og_thread_t thread;
+    og_sema_t startSema;
+    og_sema_t doneSema;
+    og_mutex_t lock;
+    WorkThreadState state;
+    volatile int quit;
+
+    WorkThreadFunc func;
+    void *userData;
+} WorkThread;
+
+static void *WorkThreadMain(void *arg) {
+    WorkThread *wt = arg;
+    for (;;) {
+        OGLockSema(wt->startSema);
+        if (wt->quit) {
+            break;
+        }
+        wt->func(wt->userData);
+        OGLockMutex(wt->lock);
+        wt->state = WORKTHREAD_DONE;
+        OGUnlockMutex(wt->lock);
+        OGUnlockSema(wt->doneSema);
+    }
+    return NULL;
+}
+
+static WorkThread *WorkThreadCreate(void) {
+    WorkThread *wt = calloc(1, sizeof(WorkThread));
+    if (wt == NULL) {
+        return NULL;
+    }
+    wt->startSema = OGCreateSema();
+    wt->doneSema = OGCreateSema();
+    wt->lock = OGCreateMutex();
+    wt->state = WORKTHREAD_IDLE;
+    wt->thread = OGCreateThread(WorkThreadMain, wt);
+    return wt;
+}
+
+//Returns 0 (and doesn't start anything) if the previous job hasn't been waited for yet
+static int WorkThreadStart(WorkThread *wt, WorkThreadFunc func, void *userData) {
+    OGLockMutex(wt->lock);
+    if (wt->state != WORKTHREAD_IDLE) {
+        OGUnlockMutex(wt->lock);
+        return 0;
+    }
+    wt->state = WORKTHREAD_RUNNING;
+    OGUnlockMutex(wt->lock);
+    wt->func = func;
+    wt->userData = userData;
+    OGUnlockSema(wt->startSema);
+    return 1;
+}
+
+static int WorkThreadIsIdle(WorkThread *wt) {
+    OGLockMutex(wt->lock);
+    int idle = wt->state == WORKTHREAD_IDLE;
+    OGUnlockMutex(wt->lock);
+    return idle;
+}
+
+static int WorkThreadIsDone(WorkThread *wt) {
+    OGLockMutex(wt->lock);
+    int done = wt->state == WORKTHREAD_DONE;
+    OGUnlockMutex(wt->lock);
+    return done;
+}
+
+//Blocks until the current job is finished, returns 0 if there wasn't one
+static int WorkThreadWait(WorkThread *wt) {
+    OGLockMutex(wt->lock);
+    int started = wt->state != WORKTHREAD_IDLE;
+    OGUnlockMutex(wt->lock);
+    if (!started) {
+        return 0;
+    }
+    OGLockSema(wt->doneSema);
+    OGLockMutex(wt->lock);
+    wt->state = WORKTHREAD_IDLE;
+    OGUnlockMutex(wt->lock);
+    return 1;
+}
+
+static void WorkThreadDestroy(WorkThread *wt) {
+    if (wt == NULL) {
+        return;
+    }
+    WorkThreadWait(wt);
+    wt->quit = 1;
+    OGUnlockSema(wt->startSema);
+    OGJoinThread(wt->thread);
+    OGDeleteSema(wt->startSema);
+    OGDeleteSema(wt->doneSema);
+    OGDeleteMutex(wt->lock);
+    free(wt);
+}
+
+#endif